@@ -8,13 +8,17 @@
 @ctype mat4 glm::mat4
 @ctype vec2 glm::vec2
 
+@block vs_uniforms
+layout(binding=0) uniform vs_params {
+    mat4 mvp;
+};
+@end
+
 @vs basic_vs
 layout(location=0) in vec2 position;
 layout(location=1) in vec2 texcoord;
 
-layout(binding=0) uniform vs_params {
-    mat4 mvp;
-};
+@include_block vs_uniforms
 
 out vec2 uv;
 
@@ -24,6 +28,21 @@ void main() {
 }
 @end
 
+// Chunk meshes, int16 positions and unorm16 texture coordinates
+@vs chunk_vs
+layout(location=0) in ivec2 position;
+layout(location=1) in vec2 texcoord;
+
+@include_block vs_uniforms
+
+out vec2 uv;
+
+void main() {
+    gl_Position = mvp * vec4(float(position.x), float(position.y), 0.0, 1.0);
+    uv = texcoord;
+}
+@end
+
 @fs basic_fs
 layout(binding=0) uniform texture2D tex;
 layout(binding=0) uniform sampler smp;
@@ -38,3 +57,4 @@ void main() {
 @end
 
 @program basic basic_vs basic_fs
+@program chunk chunk_vs basic_fs
@@ -0,0 +1,60 @@
+//
+//  tilemap.glsl
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+@ctype mat4 glm::mat4
+@ctype vec2 glm::vec2
+
+// One quad per chunk, the corners come from the vertex index so there's no vertex buffer
+@vs tilemap_vs
+layout(binding=0) uniform tilemap_vs_params {
+    mat4 mvp;
+    vec2 size; // Chunk size in world units
+};
+
+out vec2 uv;
+
+void main() {
+    const vec2 corners[6] = vec2[6](
+        vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+        vec2(1.0, 1.0), vec2(0.0, 1.0), vec2(0.0, 0.0)
+    );
+    vec2 corner = corners[gl_VertexIndex];
+    gl_Position = mvp * vec4(corner * size, 0.0, 1.0);
+    uv = corner;
+}
+@end
+
+// tiles has one texel per tile, r is the atlas column + 1 (0 for empty) and g is the row
+@fs tilemap_fs
+layout(binding=0) uniform texture2D atlas;
+layout(binding=0) uniform sampler atlas_smp;
+layout(binding=1) uniform texture2D tiles;
+layout(binding=1) uniform sampler tiles_smp;
+
+layout(binding=1) uniform tilemap_fs_params {
+    vec2 cell_size;   // Tile size in the atlas, in texture coordinates
+    vec2 cell_stride; // Tile size plus padding
+    vec2 padding;     // Padding before the first tile
+};
+
+in vec2 uv;
+
+out vec4 frag_color;
+
+void main() {
+    ivec2 count = textureSize(sampler2D(tiles, tiles_smp), 0);
+    vec2 position = uv * vec2(count);
+    ivec2 tile = clamp(ivec2(position), ivec2(0), count - 1);
+    vec2 cell = floor(texelFetch(sampler2D(tiles, tiles_smp), tile, 0).rg * 255.0 + 0.5);
+    if (cell.x == 0.0)
+        discard;
+    vec2 origin = padding + vec2(cell.x - 1.0, cell.y) * cell_stride;
+    frag_color = texture(sampler2D(atlas, atlas_smp), origin + fract(position) * cell_size);
+}
+@end
+
+@program tilemap tilemap_vs tilemap_fs
@@ -7,7 +7,6 @@
 // - see zip_put.c for more info.
 //
 //@todo: +w) int zip_append(zip*, const char *entryname, const void *buf, unsigned buflen);
-//@todo: +w) int zip_append_mem(zip*, const char *entryname, const void *buf, unsigned buflen, unsigned compr_level);
 
 #ifndef ZIP_H
 #define ZIP_H
@@ -27,6 +26,13 @@ zip* zip_open(const char *file, const char *mode /*r,w,a*/);
 // only for (w)rite or (a)ppend mode
 bool zip_append_file(zip*, const char *entryname, FILE *in, unsigned compr_level);
 bool zip_append_file_ex(zip *z, const char *filepath, const char *entryname, FILE *in, unsigned compress_level);
+bool zip_append_mem(zip*, const char *entryname, const void *buf, unsigned buflen, unsigned compr_level);
+bool zip_append_raw(zip*, const char *entryname, const void *data, unsigned datalen, unsigned rawlen, unsigned crc, unsigned codec /*0-store,8-deflate*/); // data compressed beforehand, see zip_deflate()
+
+// compress ahead of zip_append_raw(), e.g. on another thread. returns 0 if it doesn't fit or doesn't pay off
+unsigned zip_deflate(const void *in, unsigned inlen, void *out, unsigned outlen, unsigned compr_level);
+unsigned zip_deflate_bounds(unsigned inlen, unsigned compr_level);
+unsigned zip_crc32(unsigned crc, const void *data, unsigned len); // lookup table is built on first call, make that call from one thread
 
 // only for (r)ead mode
 int zip_find(zip*, const char *entryname); // convert entry to index. returns <0 if not found.
@@ -2162,6 +2168,81 @@ bool zip_append_file(zip *z, const char *entryname, FILE *in, unsigned compress_
     return zip_append_file_ex(z, entryname, NULL, in, compress_level);
 }
 
+unsigned zip_deflate(const void *in, unsigned inlen, void *out, unsigned outlen, unsigned compress_level) {
+    unsigned compSize = COMPRESS(in, inlen, out, outlen, compress_level);
+    return compSize && compSize < (inlen * 0.98) ? compSize : 0;
+}
+
+unsigned zip_deflate_bounds(unsigned inlen, unsigned compress_level) {
+    return BOUNDS(inlen, compress_level);
+}
+
+unsigned zip_crc32(unsigned crc, const void *data, unsigned len) {
+    return zip__crc32(crc, data, len);
+}
+
+bool zip_append_raw(zip *z, const char *entryname, const void *data, unsigned datalen, unsigned rawlen, unsigned crc, unsigned codec) {
+    if( !entryname ) return ERR(false, "No entry name provided");
+    if( !data && datalen ) return ERR(false, "No input buffer provided");
+
+    time_t now = time(NULL);
+    struct tm *timeinfo = localtime(&now);
+    if( !timeinfo ) return ERR(false, "Failed to get current time");
+
+    unsigned index = z->count;
+    z->entries = (zip_entry*)REALLOC(z->entries, (++z->count) * sizeof(zip_entry));
+    if(z->entries == NULL) return ERR(false, "Failed to allocate new entry!");
+
+    zip_entry *e = &z->entries[index], zero = {0};
+    *e = zero;
+    e->filename = STRDUP(entryname);
+
+    e->header.signature = 0x02014B50;
+    e->header.versionMadeBy = 10;
+    e->header.versionNeededToExtract = 10;
+    e->header.generalPurposeBitFlag = 0;
+    e->header.lastModFileTime = JZTIME(timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    e->header.lastModFileDate = JZDATE(timeinfo->tm_year+1900,timeinfo->tm_mon+1,timeinfo->tm_mday);
+    e->header.crc32 = crc;
+    e->header.uncompressedSize = rawlen;
+    e->header.compressedSize = datalen;
+    e->header.compressionMethod = codec;
+    e->header.fileNameLength = strlen(entryname);
+    e->header.externalFileAttributes = 0x20;
+    e->header.relativeOffsetOflocalHeader = (uint32_t)ftell(z->out);
+
+    // write local header, filename and blob
+    uint32_t signature = 0x04034B50;
+    fwrite(&signature, 1, sizeof(signature), z->out);
+    fwrite(&(e->header.versionNeededToExtract), 1, sizeof_JZLocalFileHeader - sizeof(signature), z->out);
+    fwrite(entryname, 1, strlen(entryname), z->out);
+    fwrite(data, 1, datalen, z->out);
+    return true;
+}
+
+bool zip_append_mem(zip *z, const char *entryname, const void *buf, unsigned buflen, unsigned compress_level) {
+    if( !buf && buflen ) return ERR(false, "No input buffer provided");
+
+    unsigned compSize = 0;
+    void *comp = 0;
+    if( compress_level && buflen ) {
+        compSize = BOUNDS(buflen, compress_level);
+        comp = REALLOC(0, compSize);
+        if( comp ) compSize = zip_deflate(buf, buflen, comp, compSize, compress_level);
+        if( !comp || !compSize ) {
+            (void)REALLOC(comp, 0);
+            comp = 0;
+        }
+    }
+
+    unsigned crc = zip__crc32(0, buf, buflen);
+    unsigned codec = comp ? (8 | (compress_level > 10 ? compress_level << 8 : 0)) : 0;
+    bool ok = comp ? zip_append_raw(z, entryname, comp, compSize, buflen, crc, codec)
+                   : zip_append_raw(z, entryname, buf, buflen, buflen, crc, codec);
+    (void)REALLOC(comp, 0);
+    return ok;
+}
+
 // zip common
 
 zip* zip_open(const char *file, const char *mode /*r,w,a*/) {
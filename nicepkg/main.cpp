@@ -840,6 +840,16 @@ static bool export_package(
 
         // Check if it's a Lua file
         if (file_path.substr(file_path.find_last_of(".")) == ".lua") {
+            // Generation hooks run in their own sandboxed states, they can't share main.lua's modules
+            if (filename == "generate.lua") {
+                FILE* f = fopen(file_path.c_str(), "rb");
+                if (f) {
+                    zip_append_file_ex(z, file_path.c_str(), filename.c_str(), f, 6);
+                    fclose(f);
+                    printf("Added %s\n", filename.c_str());
+                }
+                continue;
+            }
             // Don't include the main script if it's in extra_files
             if (std::filesystem::absolute(file_path) != std::filesystem::absolute(lua_script_path)) {
                 extra_lua_files.push_back(file_path);
@@ -0,0 +1,102 @@
+//
+//  autotile.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "json.hpp"
+#include "fmt/format.h"
+#include <array>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+// Atlas cell and texture coordinates for every tile bitmask, compiled once from the autotile.json
+// nicepkg writes into the package so meshing a tile is a single lookup
+class AutotileTable {
+public:
+    struct Cell {
+        uint16_t u0 = 0, v0 = 0;     // Texture coordinates of the top left corner, 0-65535 across the atlas
+        uint16_t u1 = 0, v1 = 0;     // and the bottom right
+        uint8_t column = 0, row = 0; // Position in the atlas, in tiles
+    };
+
+private:
+    std::array<Cell, 256> _cells;
+
+    // Only the four edges, what a simplified map is keyed on
+    static constexpr uint8_t _edge_bits = 0x5A;
+
+    static uint16_t _unorm16(int pixel, int size) {
+        return static_cast<uint16_t>(std::lround(std::clamp(pixel / static_cast<double>(size), 0.0, 1.0) * 65535.0));
+    }
+
+    static Cell _cell(int column, int row, int atlas_width, int atlas_height) {
+        if (column < 0 || column > 254 || row < 0 || row > 255)
+            throw std::runtime_error(fmt::format("autotile: cell ({}, {}) is outside the atlas", column, row));
+        // Same layout nicepkg explodes the tileset into, every tile has padding before it
+        int x = column * TILE_ORIGINAL_WIDTH + (column + 1) * TILE_PADDING;
+        int y = row * TILE_ORIGINAL_HEIGHT + (row + 1) * TILE_PADDING;
+        Cell cell;
+        cell.u0 = _unorm16(x, atlas_width);
+        cell.v0 = _unorm16(y, atlas_height);
+        cell.u1 = _unorm16(x + TILE_ORIGINAL_WIDTH, atlas_width);
+        cell.v1 = _unorm16(y + TILE_ORIGINAL_HEIGHT, atlas_height);
+        cell.column = static_cast<uint8_t>(column);
+        cell.row = static_cast<uint8_t>(row);
+        return cell;
+    }
+
+public:
+    // Every bitmask drawn with the first tile, what chunks looked like before autotiling
+    AutotileTable(int atlas_width = 1, int atlas_height = 1) {
+        _cells.fill(_cell(0, 0, atlas_width, atlas_height));
+    }
+
+    // Throws std::runtime_error if the JSON is malformed or points outside the atlas
+    // Unmapped bitmasks use the default tile, simplified maps ignore the corners first
+    static AutotileTable load(const unsigned char *data, size_t size, int atlas_width, int atlas_height) {
+        nlohmann::json json;
+        try {
+            json = nlohmann::json::parse(data, data + size);
+        } catch (const nlohmann::json::exception &e) {
+            throw std::runtime_error(fmt::format("autotile: {}", e.what()));
+        }
+        const nlohmann::json &map = json.value("autotile_map", nlohmann::json::array());
+        if (!map.is_array() || map.size() != 256)
+            throw std::runtime_error("autotile: autotile_map should have 256 entries");
+        auto mapped = [&](int bitmask, int &column, int &row) {
+            const nlohmann::json &entry = map[bitmask];
+            if (!entry.is_array() || entry.size() < 2 || !entry[0].is_number_integer() || !entry[1].is_number_integer())
+                throw std::runtime_error(fmt::format("autotile: entry {} isn't an [x, y] pair", bitmask));
+            column = entry[0].get<int>();
+            row = entry[1].get<int>();
+            return column >= 0 && row >= 0;
+        };
+
+        bool simplified = json.value("autotile_simplified", false);
+        int default_column = std::max(json.value("default_tile_x", 0), 0);
+        int default_row = std::max(json.value("default_tile_y", 0), 0);
+        AutotileTable table;
+        for (int bitmask = 0; bitmask < 256; bitmask++) {
+            int column, row;
+            if (!mapped(bitmask, column, row) &&
+                !(simplified && mapped(bitmask & _edge_bits, column, row))) {
+                column = default_column;
+                row = default_row;
+            }
+            table._cells[bitmask] = _cell(column, row, atlas_width, atlas_height);
+        }
+        return table;
+    }
+
+    const Cell& operator[](uint8_t bitmask) const {
+        return _cells[bitmask];
+    }
+};
@@ -0,0 +1,382 @@
+//
+//  benchmark.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "chunk.hpp"
+#include "chunk_map.hpp"
+#include "fmt/format.h"
+#include "sokol/sokol_time.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+
+// Headless benchmarks, run with `nice --benchmark <name>` (or `--benchmark list`)
+
+static const uint64_t BENCHMARK_SEED = Chunk::world_seed("benchmark");
+
+struct BenchmarkTimer {
+    uint64_t start = stm_now();
+
+    double ms() const {
+        return stm_ms(stm_since(start));
+    }
+};
+
+static std::vector<std::unique_ptr<Chunk>> benchmark_generate_chunks(int count) {
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    int side = 1;
+    while (side * side < count)
+        side++;
+    for (int i = 0; i < count; i++) {
+        auto chunk = std::make_unique<Chunk>(i % side - side / 2, i / side - side / 2, nullptr, nullptr);
+        chunk->fill(BENCHMARK_SEED);
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+// Size, encode and decode time of every chunk format version on the same generated chunks
+static void benchmark_chunk_format() {
+    auto chunks = benchmark_generate_chunks(BENCHMARK_CHUNK_COUNT);
+    std::cout << fmt::format("chunk-format: {} chunks of {}x{}\n", chunks.size(), CHUNK_WIDTH, CHUNK_HEIGHT);
+    std::cout << fmt::format("{:>8} {:>12} {:>12} {:>12} {:>12}\n", "version", "bytes", "bytes/chunk", "encode ms", "decode ms");
+    for (uint32_t version = 1; version <= CHUNK_FORMAT_VERSION; version++) {
+        std::vector<std::string> encoded;
+        encoded.reserve(chunks.size());
+        BenchmarkTimer encode;
+        for (auto& chunk : chunks) {
+            std::ostringstream stream;
+            chunk->serialize(stream, version);
+            encoded.push_back(stream.str());
+        }
+        double encode_ms = encode.ms();
+
+        Chunk decoded(0, 0, nullptr, nullptr);
+        BenchmarkTimer decode;
+        for (const auto& data : encoded)
+            decoded.deserialize(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        double decode_ms = decode.ms();
+
+        // Round trip has to come back byte for byte
+        for (size_t i = 0; i < chunks.size(); i++) {
+            Chunk check(chunks[i]->x(), chunks[i]->y(), nullptr, nullptr);
+            check.deserialize(reinterpret_cast<const uint8_t*>(encoded[i].data()), encoded[i].size());
+            std::ostringstream stream;
+            check.serialize(stream, version);
+            if (stream.str() != encoded[i])
+                throw std::runtime_error(fmt::format("chunk-format: v{} round trip mismatch at chunk {}", version, i));
+        }
+
+        size_t total = 0;
+        for (const auto& data : encoded)
+            total += data.size();
+        std::cout << fmt::format("{:>8} {:>12} {:>12.1f} {:>12.3f} {:>12.3f}\n", fmt::format("v{}", version),
+                                 total, total / static_cast<double>(chunks.size()),
+                                 encode_ms / chunks.size(), decode_ms / chunks.size());
+    }
+}
+
+// Per-chunk cost of recomputing every autotile bitmask, one tile at a time vs a row of bit planes at a time
+static void benchmark_bitmask() {
+    auto chunks = benchmark_generate_chunks(BENCHMARK_CHUNK_COUNT);
+    std::vector<uint8_t> expected(CHUNK_SIZE);
+    double scalar_ms = 0.0, planes_ms = 0.0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        Chunk &chunk = *chunks[i];
+        BenchmarkTimer scalar;
+        chunk.recalculate_bitmasks(true);
+        scalar_ms += scalar.ms();
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++)
+                expected[y * CHUNK_WIDTH + x] = chunk.tile(x, y)->bitmask;
+
+        BenchmarkTimer planes;
+        chunk.recalculate_bitmasks();
+        planes_ms += planes.ms();
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++)
+                if (chunk.tile(x, y)->bitmask != expected[y * CHUNK_WIDTH + x])
+                    throw std::runtime_error(fmt::format("bitmask: mismatch at ({}, {}) in chunk {}", x, y, i));
+    }
+    std::cout << fmt::format("bitmask: {} chunks of {}x{}\n", chunks.size(), CHUNK_WIDTH, CHUNK_HEIGHT);
+    std::cout << fmt::format("{:>8} {:>12}\n", "kernel", "ms/chunk");
+    std::cout << fmt::format("{:>8} {:>12.3f}\n", "scalar", scalar_ms / chunks.size());
+    std::cout << fmt::format("{:>8} {:>12.3f}\n", "planes", planes_ms / chunks.size());
+}
+
+// Per-chunk time and size of each way of meshing a chunk. The six float vertices a tile chunks
+// used to have are only sized, not built, for comparison
+static void benchmark_mesh() {
+    auto chunks = benchmark_generate_chunks(BENCHMARK_CHUNK_COUNT);
+    AutotileTable autotile;
+    size_t solid = 0, vertex_bytes = 0;
+    double vertices_ms = 0.0, texels_ms = 0.0, overview_ms = 0.0;
+    for (auto& chunk : chunks) {
+        size_t tiles = 0;
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++)
+                tiles += chunk->tile(x, y)->solid;
+        solid += tiles;
+
+        BenchmarkTimer vertices;
+        auto mesh = chunk->vertices(autotile);
+        vertices_ms += vertices.ms();
+        if (mesh.second != tiles * 4)
+            throw std::runtime_error(fmt::format("mesh: chunk ({}, {}) has {} vertices for {} solid tiles",
+                                                 chunk->x(), chunk->y(), mesh.second, tiles));
+        vertex_bytes += mesh.second * sizeof(ChunkVertex);
+
+        BenchmarkTimer texels;
+        auto image = chunk->tile_texels(autotile);
+        texels_ms += texels.ms();
+
+        BenchmarkTimer overview;
+        auto small = chunk->overview_texels(autotile);
+        overview_ms += overview.ms();
+    }
+    double count = static_cast<double>(chunks.size());
+    std::cout << fmt::format("mesh: {} chunks of {}x{}, {:.1f} solid tiles per chunk\n", chunks.size(),
+                             CHUNK_WIDTH, CHUNK_HEIGHT, solid / count);
+    std::cout << fmt::format("{:>8} {:>12} {:>12}\n", "format", "bytes/chunk", "ms/chunk");
+    std::cout << fmt::format("{:>8} {:>12.1f} {:>12}\n", "float", solid * 6 * sizeof(float) * 4 / count, "-");
+    std::cout << fmt::format("{:>8} {:>12.1f} {:>12.3f}\n", "compact", vertex_bytes / count, vertices_ms / count);
+    std::cout << fmt::format("{:>8} {:>12.1f} {:>12.3f}\n", "tilemap", CHUNK_SIZE * 2.0, texels_ms / count);
+    std::cout << fmt::format("{:>8} {:>12.1f} {:>12.3f}\n", "overview",
+                             CHUNK_SIZE * 2.0 / (CHUNK_OVERVIEW_SCALE * CHUNK_OVERVIEW_SCALE), overview_ms / count);
+    std::cout << fmt::format("Compact meshes share one {}KB index buffer\n", Chunk::quad_indices().size() * sizeof(uint32_t) / 1024);
+}
+
+// Time to generate a chunk from the seed, and a check that it comes out the same every time
+static void benchmark_generate() {
+    BenchmarkTimer timer;
+    auto chunks = benchmark_generate_chunks(BENCHMARK_CHUNK_COUNT);
+    double ms = timer.ms();
+    size_t solid = 0;
+    for (auto& chunk : chunks) {
+        Chunk again(chunk->x(), chunk->y(), nullptr, nullptr);
+        again.fill(BENCHMARK_SEED);
+        if (again.encode() != chunk->encode())
+            throw std::runtime_error(fmt::format("generate: chunk ({}, {}) isn't deterministic", chunk->x(), chunk->y()));
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++)
+                solid += chunk->tile(x, y)->solid;
+    }
+    std::cout << fmt::format("generate: {} chunks of {}x{}, {} smoothing iterations\n", chunks.size(),
+                             CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_SMOOTH_ITERATIONS);
+    std::cout << fmt::format("{:>12} {:>12}\n", "ms/chunk", "solid");
+    std::cout << fmt::format("{:>12.3f} {:>11.1f}%\n", ms / chunks.size(),
+                             100.0 * solid / (static_cast<double>(chunks.size()) * CHUNK_SIZE));
+}
+
+// Time spent in each generation stage per chunk, decorating a block of chunks in two different
+// orders has to give the same result or the pipeline's output would depend on scheduling
+static void benchmark_stages() {
+    int side = 1;
+    while (side * side < BENCHMARK_CHUNK_COUNT)
+        side++;
+    int span = side + 2; // A ring of neighbours around the chunks being decorated
+    auto grid = [&]() {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        for (int i = 0; i < span * span; i++)
+            chunks.push_back(std::make_unique<Chunk>(i % span, i / span, nullptr, nullptr));
+        return chunks;
+    };
+    auto surroundings = [&](std::vector<std::unique_ptr<Chunk>> &chunks, int x, int y) {
+        ChunkSurroundings area;
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++)
+                chunks[(y + dy) * span + x + dx]->copy_surroundings(dx, dy, area);
+        return area;
+    };
+
+    double ms[4] = {0};
+    auto chunks = grid();
+    BenchmarkTimer terrain;
+    for (auto& chunk : chunks)
+        chunk->generate_terrain(BENCHMARK_SEED);
+    ms[0] = terrain.ms() / chunks.size();
+    BenchmarkTimer smooth;
+    for (auto& chunk : chunks)
+        chunk->smooth();
+    ms[1] = smooth.ms() / chunks.size();
+    BenchmarkTimer decorate;
+    for (int y = 1; y <= side; y++)
+        for (int x = 1; x <= side; x++)
+            chunks[y * span + x]->decorate(BENCHMARK_SEED, surroundings(chunks, x, y));
+    ms[2] = decorate.ms() / (side * side);
+    BenchmarkTimer seed;
+    for (int y = 1; y <= side; y++)
+        for (int x = 1; x <= side; x++)
+            chunks[y * span + x]->seed_entities(BENCHMARK_SEED);
+    ms[3] = seed.ms() / (side * side);
+
+    auto again = grid();
+    for (auto& chunk : again)
+        chunk->fill(BENCHMARK_SEED);
+    for (int y = side; y >= 1; y--)
+        for (int x = side; x >= 1; x--) {
+            again[y * span + x]->decorate(BENCHMARK_SEED, surroundings(again, x, y));
+            again[y * span + x]->seed_entities(BENCHMARK_SEED);
+        }
+    size_t decorations = 0, spawns = 0;
+    for (int y = 1; y <= side; y++)
+        for (int x = 1; x <= side; x++) {
+            Chunk &chunk = *chunks[y * span + x];
+            if (chunk.encode() != again[y * span + x]->encode())
+                throw std::runtime_error(fmt::format("stages: chunk ({}, {}) depends on the decoration order", x, y));
+            for (int ty = 0; ty < CHUNK_HEIGHT; ty++)
+                for (int tx = 0; tx < CHUNK_WIDTH; tx++) {
+                    uint8_t extra = chunk.tile(tx, ty)->extra;
+                    decorations += extra == TILE_EXTRA_DECORATION;
+                    spawns += extra == TILE_EXTRA_SPAWN;
+                }
+        }
+
+    std::cout << fmt::format("stages: {} chunks of {}x{}, {} decorations, {} spawn points\n", side * side,
+                             CHUNK_WIDTH, CHUNK_HEIGHT, decorations, spawns);
+    std::cout << fmt::format("{:>10} {:>12}\n", "stage", "ms/chunk");
+    const ChunkStage stages[4] = {ChunkStage::Terrain, ChunkStage::Smoothed, ChunkStage::Decorated, ChunkStage::Seeded};
+    for (int i = 0; i < 4; i++)
+        std::cout << fmt::format("{:>10} {:>12.3f}\n", Chunk::stage_to_string(stages[i]), ms[i]);
+}
+
+// Readers looking chunks up and reading tiles the way path requests do, while one thread keeps
+// releasing and loading chunks. The old unordered_map behind a shared_mutex against ChunkMap
+static void benchmark_chunk_map() {
+    auto chunks = benchmark_generate_chunks(BENCHMARK_CHUNK_COUNT);
+    unsigned int cores = std::thread::hardware_concurrency();
+    int readers = std::max(2, static_cast<int>(cores) - 1);
+    const int lookups = 200000;
+
+    struct Result {
+        double ms;
+        uint64_t writes;
+        uint64_t misses;
+    };
+    // find returns the chunk or nullptr, write swaps a chunk out and back in
+    auto run = [&](auto find, auto write) {
+        std::atomic<bool> done{false};
+        std::atomic<uint64_t> misses{0};
+        uint64_t writes = 0;
+        BenchmarkTimer timer;
+        std::thread writer([&]() {
+            uint64_t state = 1;
+            while (!done.load()) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                write(*chunks[(state >> 33) % chunks.size()]);
+                writes++;
+            }
+        });
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++)
+            threads.emplace_back([&, r]() {
+                uint64_t state = r + 1, missed = 0;
+                for (int i = 0; i < lookups; i++) {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    Chunk &wanted = *chunks[(state >> 33) % chunks.size()];
+                    if (!find(wanted.id(), [&](Chunk &chunk) {
+                        for (int t = 0; t < 4; t++)
+                            chunk.tile(static_cast<int>((state >> (t * 8)) % CHUNK_WIDTH), static_cast<int>((state >> (t * 8 + 4)) % CHUNK_HEIGHT));
+                    }))
+                        missed++;
+                }
+                misses += missed;
+            });
+        for (auto& thread : threads)
+            thread.join();
+        double ms = timer.ms();
+        done.store(true);
+        writer.join();
+        return Result{ms, writes, misses.load()};
+    };
+
+    std::unordered_map<uint64_t, Chunk*> locked;
+    std::shared_mutex lock;
+    for (auto& chunk : chunks)
+        locked[chunk->id()] = chunk.get();
+    Result before = run([&](uint64_t id, auto &&use) {
+        std::shared_lock<std::shared_mutex> read(lock);
+        auto it = locked.find(id);
+        if (it == locked.end())
+            return false;
+        use(*it->second);
+        return true;
+    }, [&](Chunk &chunk) {
+        {
+            std::unique_lock<std::shared_mutex> write(lock);
+            locked.erase(chunk.id());
+        }
+        std::unique_lock<std::shared_mutex> write(lock);
+        locked[chunk.id()] = &chunk;
+    });
+
+    ChunkMap map;
+    for (auto& chunk : chunks)
+        map.emplace(chunk->id(), ChunkLifecycle::Uploaded, chunk.get());
+    Result after = run([&](uint64_t id, auto &&use) {
+        ChunkMap::Pin pin;
+        Chunk *chunk = map.find(id);
+        if (chunk == nullptr)
+            return false;
+        use(*chunk);
+        return true;
+    }, [&](Chunk &chunk) {
+        map.erase(chunk.id());
+        map.emplace(chunk.id(), ChunkLifecycle::Uploaded, &chunk);
+        map.collect();
+    });
+    if (map.size() != chunks.size() || map.collect() != 0)
+        throw std::runtime_error(fmt::format("chunk-map: {} chunks left of {}", map.size(), chunks.size()));
+
+    std::cout << fmt::format("chunk-map: {} chunks, {} readers doing {} lookups each, 1 writer\n",
+                             chunks.size(), readers, lookups);
+    std::cout << fmt::format("{:>14} {:>12} {:>12} {:>12}\n", "map", "lookups/ms", "writes/ms", "missed");
+    for (const auto& [name, result] : {std::make_pair("shared_mutex", before), std::make_pair("ChunkMap", after)})
+        std::cout << fmt::format("{:>14} {:>12.1f} {:>12.1f} {:>12}\n", name,
+                                 static_cast<double>(readers) * lookups / result.ms, result.writes / result.ms, result.misses);
+}
+
+struct Benchmark {
+    const char *name;
+    const char *description;
+    std::function<void()> run;
+};
+
+static const std::vector<Benchmark>& benchmarks() {
+    static const std::vector<Benchmark> list = {
+        {"chunk-format", "Chunk file size and encode/decode time for each format version", benchmark_chunk_format},
+        {"bitmask", "Autotile bitmask calculation, scalar vs bit-parallel", benchmark_bitmask},
+        {"generate", "Seeded cave generation time per chunk", benchmark_generate},
+        {"mesh", "Chunk mesh build time and size, compact vertices vs the tile image and overview", benchmark_mesh},
+        {"stages", "Time per generation stage, and that decoration doesn't depend on order", benchmark_stages},
+        {"chunk-map", "Chunk lookups under path-request load while chunks are swapped in and out", benchmark_chunk_map},
+    };
+    return list;
+}
+
+// Returns false if there's no benchmark with that name
+static bool run_benchmark(const std::string &name) {
+    stm_setup();
+    bool found = false;
+    for (const auto& benchmark : benchmarks())
+        if (name == "list")
+            std::cout << fmt::format("{:<16} {}\n", benchmark.name, benchmark.description);
+        else if (name == "all" || name == benchmark.name) {
+            benchmark.run();
+            found = true;
+        }
+    return found || name == "list";
+}
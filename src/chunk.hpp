@@ -9,16 +9,23 @@
 
 #include "nice_config.h"
 #include "vertex_batch.hpp"
+#include "autotile.hpp"
 #include "camera.hpp"
 #include <unordered_set>
 #include <shared_mutex>
 #include <random>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <memory>
 #include <queue>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <string>
 #include "fmt/format.h"
 #include "basic.glsl.h"
+#include "tilemap.glsl.h"
 
 extern uint64_t index(int x, int y);
 extern std::pair<int, int> unindex(uint64_t i);
@@ -39,9 +46,65 @@ enum class ChunkVisibility {
     Occluded
 };
 
+// Generation stages in the order they run, see ChunkPipeline
+// Chunks loaded from disk start out at Seeded, only meshing is left
+enum class ChunkStage : uint8_t {
+    Empty,
+    Terrain,   // Noise for the chunk and its margin
+    Smoothed,  // Cave automaton has run, tiles and halo are filled in
+    Decorated, // Decorations placed, reads the smoothed neighbours
+    Seeded,    // Entity spawn points marked
+    Meshed
+};
+
+// What the generator writes into Tile::extra
+enum TileExtra : uint8_t {
+    TILE_EXTRA_NONE = 0,
+    TILE_EXTRA_DECORATION,
+    TILE_EXTRA_SPAWN
+};
+
+// Solid tiles of a chunk and a margin around it copied from its neighbours, x-major like Chunk
+// Anything not copied in counts as solid
+struct ChunkSurroundings {
+    static constexpr int margin = CHUNK_DECORATION_RADIUS + 1;
+    static constexpr int width = CHUNK_WIDTH + margin * 2;
+    static constexpr int height = CHUNK_HEIGHT + margin * 2;
+    std::vector<uint8_t> solid = std::vector<uint8_t>(width * height, 1);
+    bool generated = true; // Every chunk copied in was untouched generator output
+
+    uint8_t at(int x, int y) const {
+        return solid[(x + margin) * height + y + margin];
+    }
+};
+
+// Four a tile, drawn through the shared index buffer from ChunkManager, see Chunk::quad_indices()
 struct ChunkVertex {
-    glm::vec2 position;
-    glm::vec2 texcoord;
+    int16_t x, y;  // Position in the chunk, in world units
+    uint16_t u, v; // Texture coordinates, 0-65535 across the atlas
+};
+// The far edge of the last tile has to fit as well, or vertices wrap around silently
+static_assert(static_cast<long long>(CHUNK_WIDTH) * TILE_WIDTH <= std::numeric_limits<int16_t>::max() &&
+              static_cast<long long>(CHUNK_HEIGHT) * TILE_HEIGHT <= std::numeric_limits<int16_t>::max(),
+              "Chunk is too big in world units for ChunkVertex's int16 positions");
+
+struct ChunkMemoryStats {
+    size_t tile_bytes = 0;
+    size_t vertex_count = 0;
+    size_t cpu_vertex_bytes = 0;
+    size_t gpu_vertex_bytes = 0;
+
+    size_t total() const {
+        return tile_bytes + cpu_vertex_bytes + gpu_vertex_bytes;
+    }
+
+    ChunkMemoryStats& operator+=(const ChunkMemoryStats &other) {
+        tile_bytes += other.tile_bytes;
+        vertex_count += other.vertex_count;
+        cpu_vertex_bytes += other.cpu_vertex_bytes;
+        gpu_vertex_bytes += other.gpu_vertex_bytes;
+        return *this;
+    }
 };
 
 class Chunk {
@@ -49,24 +112,77 @@ class Chunk {
     Tile _tiles[CHUNK_WIDTH][CHUNK_HEIGHT];
     mutable std::shared_mutex _read_mutex;
     mutable std::mutex _write_mutex;
-    VertexBatch<ChunkVertex, CHUNK_SIZE * 6, false> _batch;
+    VertexBatch<ChunkVertex, 4, false> _batch;
+    // Vertices from mesh() waiting for upload(), the batch is only touched on the main thread so
+    // the count draw() uses always matches the buffer it binds
+    std::unique_ptr<ChunkVertex[]> _pending_vertices;
+    size_t _pending_count = 0;
+    // Tile index image, the other way of drawing a chunk. Two bytes a tile instead of six vertices
+    std::unique_ptr<uint8_t[]> _tile_texels; // CPU copy from mesh() until upload()
+    sg_image _tile_image = {SG_INVALID_ID};
+    // Same format at a lower resolution, drawn instead of either when zoomed out
+    std::unique_ptr<uint8_t[]> _overview_texels;
+    sg_image _overview_image = {SG_INVALID_ID};
     std::atomic<bool> _is_filled = false;
+    std::atomic<bool> _is_meshed = false;
     std::atomic<bool> _is_built = false;
     std::atomic<bool> _is_destroyed = false;
+    std::atomic<uint64_t> _revision = 0;       // Bumped on every tile change
+    std::atomic<uint64_t> _saved_revision = 0; // Revision that's on disk
+    std::atomic<bool> _is_generated = false;   // Untouched generator output, can always be regenerated
+    std::atomic<ChunkStage> _stage = ChunkStage::Empty;
     std::atomic<ChunkVisibility> _visibility = ChunkVisibility::OutOfSign;
     glm::mat4 _mvp;
     Camera *_camera;
     Texture *_texture;
     std::atomic<bool> _rebuild_mvp = true;
 
-    static uint8_t tile_bitmask(Chunk *chunk, int cx, int cy, int oob) {
+    // Terrain is generated for the chunk plus a margin on every side, the automaton only looks
+    // one tile out per iteration so everything within the margin minus the iterations comes out
+    // the same as in the neighbouring chunks. The ring just outside the chunk becomes the halo.
+    static constexpr int _margin = CHUNK_SMOOTH_ITERATIONS + 1;
+    static constexpr int _terrain_width = CHUNK_WIDTH + _margin * 2;
+    static constexpr int _terrain_height = CHUNK_HEIGHT + _margin * 2;
+    static constexpr int _terrain_words = (_terrain_width + 63) / 64;
+    std::unique_ptr<uint64_t[][_terrain_words]> _terrain; // Only between the Terrain and Smoothed stages
+
+    // Solid state of the ring of tiles just outside the chunk, only used for the edge bitmasks
+    // Solid until fill() generates it or a resident neighbour hands over its real tiles
+    struct {
+        uint8_t north[CHUNK_WIDTH + 2]; // y = -1, x = -1 .. CHUNK_WIDTH
+        uint8_t south[CHUNK_WIDTH + 2]; // y = CHUNK_HEIGHT, x = -1 .. CHUNK_WIDTH
+        uint8_t west[CHUNK_HEIGHT];     // x = -1
+        uint8_t east[CHUNK_HEIGHT];     // x = CHUNK_WIDTH
+    } _halo;
+
+    uint8_t& _halo_at(int x, int y) {
+        if (y < 0)
+            return _halo.north[x + 1];
+        if (y >= CHUNK_HEIGHT)
+            return _halo.south[x + 1];
+        return x < 0 ? _halo.west[y] : _halo.east[y];
+    }
+
+    template<typename F>
+    void _each_halo_tile(F f) {
+        for (int x = -1; x <= CHUNK_WIDTH; x++) {
+            f(x, -1, _halo.north[x + 1]);
+            f(x, CHUNK_HEIGHT, _halo.south[x + 1]);
+        }
+        for (int y = 0; y < CHUNK_HEIGHT; y++) {
+            f(-1, y, _halo.west[y]);
+            f(CHUNK_WIDTH, y, _halo.east[y]);
+        }
+    }
+
+    static uint8_t tile_bitmask(Chunk *chunk, int cx, int cy) {
         uint8_t neighbours[9] = {0};
         for (int x = -1; x < 2; x++)
             for (int y = -1; y < 2; y++) {
                 int dx = cx+x, dy = cy+y;
                 // Direct access to _tiles since we're already holding the mutex in fill()
                 Tile* tile = dx < 0 || dy < 0 || dx >= CHUNK_WIDTH || dy >= CHUNK_HEIGHT ? nullptr : &chunk->_tiles[dx][dy];
-                neighbours[(y+1)*3+(x+1)] = !x && !y ? 0 : tile == nullptr ? oob : tile->solid ? 1 : 0;
+                neighbours[(y+1)*3+(x+1)] = !x && !y ? 0 : tile == nullptr ? chunk->_halo_at(dx, dy) : tile->solid ? 1 : 0;
             }
         neighbours[0] = !neighbours[1] || !neighbours[3] ? 0 : neighbours[0];
         neighbours[2] = !neighbours[1] || !neighbours[5] ? 0 : neighbours[2];
@@ -80,40 +196,234 @@ class Chunk {
         return result;
     }
 
-    ChunkVertex *generate_quad(glm::vec2 position, glm::vec2 clip_offset) {
-        int _x = static_cast<int>(position.x);
-        int _y = static_cast<int>(position.y);
-        glm::vec2 _positions[] = {
-            {_x, _y},                            // Top-left
-            {_x + TILE_WIDTH, _y},               // Top-right
-            {_x + TILE_WIDTH, _y + TILE_HEIGHT}, // Bottom-right
-            {_x, _y + TILE_HEIGHT},              // Bottom-left
+    void _calculate_bitmasks_scalar() {
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++)
+                _tiles[x][y].bitmask = _tiles[x][y].solid ? tile_bitmask(this, x, y) : 0;
+    }
+
+    // Only the tiles along the chunk's edges, after the halo changed. Returns true if any changed
+    bool _calculate_edge_bitmasks() {
+        bool changed = false;
+        auto update = [&](int x, int y) {
+            uint8_t bitmask = _tiles[x][y].solid ? tile_bitmask(this, x, y) : 0;
+            changed |= bitmask != _tiles[x][y].bitmask;
+            _tiles[x][y].bitmask = bitmask;
+        };
+        for (int x = 0; x < CHUNK_WIDTH; x++) {
+            update(x, 0);
+            update(x, CHUNK_HEIGHT - 1);
+        }
+        for (int y = 1; y < CHUNK_HEIGHT - 1; y++) {
+            update(0, y);
+            update(CHUNK_WIDTH - 1, y);
+        }
+        return changed;
+    }
+
+    // Same result as tile_bitmask() for the whole chunk, one row of 64 tiles at a time
+    // Solid tiles are packed into bit rows, every neighbour direction is then a shifted AND
+    // of the rows above, below and the row itself. The halo supplies the bits past the edges.
+    void _calculate_bitmasks() {
+        constexpr int words = (CHUNK_WIDTH + 63) / 64;
+        uint64_t rows[CHUNK_HEIGHT + 2][words];
+        uint64_t west_edge[CHUNK_HEIGHT + 2], east_edge[CHUNK_HEIGHT + 2]; // x = -1 and x = CHUNK_WIDTH
+        for (int y = -1; y <= CHUNK_HEIGHT; y++) {
+            west_edge[y + 1] = _halo_at(-1, y);
+            east_edge[y + 1] = _halo_at(CHUNK_WIDTH, y);
+            // Bits past the last column repeat the east edge
+            for (int w = 0; w < words; w++)
+                rows[y + 1][w] = east_edge[y + 1] ? ~0ULL : 0;
+        }
+        for (int x = 0; x < CHUNK_WIDTH; x++) {
+            uint64_t bit = 1ULL << (x % 64);
+            rows[0][x / 64] = _halo.north[x + 1] ? rows[0][x / 64] | bit : rows[0][x / 64] & ~bit;
+            rows[CHUNK_HEIGHT + 1][x / 64] = _halo.south[x + 1] ? rows[CHUNK_HEIGHT + 1][x / 64] | bit : rows[CHUNK_HEIGHT + 1][x / 64] & ~bit;
+        }
+        // Tiles are stored a column at a time, walk them in that order
+        for (int x = 0; x < CHUNK_WIDTH; x++)
+            for (int y = 0; y < CHUNK_HEIGHT; y++) {
+                uint64_t bit = 1ULL << (x % 64);
+                rows[y + 1][x / 64] = _tiles[x][y].solid ? rows[y + 1][x / 64] | bit : rows[y + 1][x / 64] & ~bit;
+            }
+
+        // Bit x of the result is bit x-1 (west) or x+1 (east) of row r
+        auto west = [&](int r, int w) {
+            return (rows[r][w] << 1) | (w > 0 ? rows[r][w - 1] >> 63 : west_edge[r]);
+        };
+        auto east = [&](int r, int w) {
+            return (rows[r][w] >> 1) | ((w + 1 < words ? rows[r][w + 1] : east_edge[r]) << 63);
         };
 
-        int _clip_x = static_cast<int>(clip_offset.x);
-        int _clip_y = static_cast<int>(clip_offset.y);
-        int _texture_width = _texture->width();
-        int _texture_height = _texture->height();
-        float iw = 1.f / _texture_width;
-        float ih = 1.f / _texture_height;
-        float tl = _clip_x * iw;
-        float tt = _clip_y * ih;
-        float tr = (_clip_x + TILE_ORIGINAL_WIDTH) * iw;
-        float tb = (_clip_y + TILE_ORIGINAL_HEIGHT) * ih;
-        glm::vec2 _texcoords[4] = {
-            {tl, tt}, // top left
-            {tr, tt}, // top right
-            {tr, tb}, // bottom right
-            {tl, tb}, // bottom left
+        static thread_local uint8_t masks[CHUNK_HEIGHT][words * 64]; // Too big for a worker's stack
+        for (int y = 0; y < CHUNK_HEIGHT; y++) {
+            for (int w = 0; w < words; w++) {
+                uint64_t n = rows[y][w], s = rows[y + 2][w];
+                uint64_t wv = west(y + 1, w), e = east(y + 1, w);
+                // Same order as the bits in tile_bitmask(), corners need both of their edges
+                uint64_t planes[8] = {
+                    west(y, w) & n & wv, n, east(y, w) & n & e,
+                    wv, e,
+                    west(y + 2, w) & s & wv, s, east(y + 2, w) & s & e
+                };
+                for (int i = 0; i < 8; i++)
+                    planes[i] &= rows[y + 1][w];
+
+                // Transpose 8 tiles x 8 planes so each byte becomes one tile's bitmask
+                for (int b = 0; b < 8; b++) {
+                    uint64_t m = 0;
+                    for (int i = 0; i < 8; i++)
+                        m |= ((planes[i] >> (b * 8)) & 0xFF) << (i * 8);
+                    uint64_t t = (m ^ (m >> 7)) & 0x00AA00AA00AA00AAULL;
+                    m ^= t ^ (t << 7);
+                    t = (m ^ (m >> 14)) & 0x0000CCCC0000CCCCULL;
+                    m ^= t ^ (t << 14);
+                    t = (m ^ (m >> 28)) & 0x00000000F0F0F0F0ULL;
+                    m ^= t ^ (t << 28);
+                    memcpy(&masks[y][w * 64 + b * 8], &m, sizeof(m)); // Little endian, byte i is tile i
+                }
+            }
+        }
+        for (int x = 0; x < CHUNK_WIDTH; x++)
+            for (int y = 0; y < CHUNK_HEIGHT; y++)
+                _tiles[x][y].bitmask = masks[y][x];
+    }
+
+    static uint64_t _splitmix64(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // Random value for a tile, depends only on the seed and the tile's world position
+    static uint64_t _tile_noise(uint64_t seed, int64_t tx, int64_t ty) {
+        return _splitmix64(seed ^ _splitmix64((static_cast<uint64_t>(tx) << 32) ^ static_cast<uint32_t>(ty)));
+    }
+
+    // Mask of the bits where a count held in 4 bit slices is at least k
+    static uint64_t _count_at_least(const uint64_t count[4], int k) {
+        uint64_t greater = 0, equal = ~0ULL;
+        for (int b = 3; b >= 0; b--)
+            if ((k >> b) & 1)
+                equal &= count[b];
+            else {
+                greater |= equal & count[b];
+                equal &= ~count[b];
+            }
+        return greater | equal;
+    }
+
+    // Cave automaton over rows of packed bits, out of bounds counts as solid
+    // Neighbours are summed with bit-sliced adders, so a whole row of tiles is one
+    // pass of shifts, ANDs and XORs per 64 tiles.
+    template<int Width, int Height>
+    static void _smooth(uint64_t (*rows)[(Width + 63) / 64], int iterations) {
+        constexpr int words = (Width + 63) / 64;
+        constexpr int spare = words * 64 - Width;
+        const uint64_t padding = spare ? ~0ULL << ((64 - spare) % 64) : 0;
+        uint64_t next[Height + 2][words];
+        for (int w = 0; w < words; w++)
+            next[0][w] = next[Height + 1][w] = ~0ULL;
+
+        auto west = [](const uint64_t *row, int w) {
+            return (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 1ULL);
+        };
+        auto east = [](const uint64_t *row, int w) {
+            return (row[w] >> 1) | ((w + 1 < words ? row[w + 1] : ~0ULL) << 63);
         };
 
-        ChunkVertex *v = new ChunkVertex[6];
-        static uint16_t _indices[] = {0, 1, 2, 2, 3, 0};
-        for (int i = 0; i < 6; i++) {
-            v[i].position = _positions[_indices[i]];
-            v[i].texcoord = _texcoords[_indices[i]];
+        for (int i = 0; i < iterations; i++) {
+            for (int y = 1; y <= Height; y++) {
+                const uint64_t *up = rows[y - 1], *mid = rows[y], *down = rows[y + 1];
+                for (int w = 0; w < words; w++) {
+                    const uint64_t neighbours[8] = {
+                        west(up, w), up[w], east(up, w),
+                        west(mid, w), east(mid, w),
+                        west(down, w), down[w], east(down, w)
+                    };
+                    uint64_t count[4] = {0};
+                    for (uint64_t bit : neighbours) {
+                        uint64_t carry = count[0] & bit;
+                        count[0] ^= bit;
+                        uint64_t carry2 = count[1] & carry;
+                        count[1] ^= carry;
+                        uint64_t carry3 = count[2] & carry2;
+                        count[2] ^= carry2;
+                        count[3] |= carry3;
+                    }
+                    // Solid tiles starve without enough solid neighbours, empty ones fill in when surrounded
+                    next[y][w] = (mid[w] & _count_at_least(count, CHUNK_STARVE)) |
+                                 (~mid[w] & _count_at_least(count, CHUNK_SURVIVE + 1));
+                }
+                next[y][words - 1] |= padding;
+            }
+            memcpy(rows, next, sizeof(next));
         }
-        return v;
+    }
+
+    static int64_t _floor_div(int64_t a, int64_t b) {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    // Poisson disc placement in world tile coordinates, returns the points inside the area
+    // Every radius sized cell of the world proposes one point, a valid point is kept unless a
+    // valid point with a higher priority is within the radius. Nothing depends on the order
+    // points are looked at, so the chunks on either side of a border agree on what's kept.
+    template<typename Valid>
+    static std::vector<std::pair<int64_t, int64_t>> _poisson_disc(uint64_t seed, int64_t x0, int64_t y0, int w, int h, int radius, Valid valid) {
+        struct Candidate {
+            int64_t x, y;
+            uint64_t priority;
+            bool valid;
+        };
+        // One ring of cells past the ones touching the area, a point can only be beaten by one in the next cell
+        int64_t cx0 = _floor_div(x0, radius) - 1, cy0 = _floor_div(y0, radius) - 1;
+        int64_t cx1 = _floor_div(x0 + w - 1, radius) + 1, cy1 = _floor_div(y0 + h - 1, radius) + 1;
+        int cw = static_cast<int>(cx1 - cx0 + 1), ch = static_cast<int>(cy1 - cy0 + 1);
+        std::vector<Candidate> cells(cw * ch);
+        for (int i = 0; i < cw; i++)
+            for (int j = 0; j < ch; j++) {
+                uint64_t noise = _tile_noise(seed, cx0 + i, cy0 + j);
+                Candidate &c = cells[i * ch + j];
+                c.x = (cx0 + i) * radius + static_cast<int64_t>(noise % radius);
+                c.y = (cy0 + j) * radius + static_cast<int64_t>((noise >> 32) % radius);
+                c.priority = _splitmix64(noise);
+                // Too far out to be within the radius of anything inside the area
+                c.valid = c.x > x0 - radius && c.x < x0 + w + radius &&
+                          c.y > y0 - radius && c.y < y0 + h + radius && valid(c.x, c.y);
+            }
+
+        std::vector<std::pair<int64_t, int64_t>> points;
+        for (int i = 1; i < cw - 1; i++)
+            for (int j = 1; j < ch - 1; j++) {
+                const Candidate &c = cells[i * ch + j];
+                if (!c.valid || c.x < x0 || c.y < y0 || c.x >= x0 + w || c.y >= y0 + h)
+                    continue;
+                bool kept = true;
+                for (int ni = i - 1; ni <= i + 1 && kept; ni++)
+                    for (int nj = j - 1; nj <= j + 1 && kept; nj++) {
+                        const Candidate &n = cells[ni * ch + nj];
+                        if (&n == &c || !n.valid)
+                            continue;
+                        int64_t dx = n.x - c.x, dy = n.y - c.y;
+                        if (dx * dx + dy * dy < static_cast<int64_t>(radius) * radius && n.priority > c.priority)
+                            kept = false;
+                    }
+                if (kept)
+                    points.emplace_back(c.x - x0, c.y - y0);
+            }
+        return points;
+    }
+
+    // Corners in the order quad_indices() expects, top left then clockwise
+    static void _write_quad(ChunkVertex *out, int x, int y, const AutotileTable::Cell &cell) {
+        int16_t x0 = static_cast<int16_t>(x * TILE_WIDTH), x1 = static_cast<int16_t>(x0 + TILE_WIDTH);
+        int16_t y0 = static_cast<int16_t>(y * TILE_HEIGHT), y1 = static_cast<int16_t>(y0 + TILE_HEIGHT);
+        out[0] = {x0, y0, cell.u0, cell.v0};
+        out[1] = {x1, y0, cell.u1, cell.v0};
+        out[2] = {x1, y1, cell.u1, cell.v1};
+        out[3] = {x0, y1, cell.u0, cell.v1};
     }
 
     struct ChunkHeader {
@@ -176,7 +486,7 @@ class Chunk {
     }
 
     template<typename FieldGetter>
-    void _serialize_field_rle(std::ofstream& file, FieldGetter getter) const {
+    void _serialize_field_rle(std::ostream& file, FieldGetter getter) const {
         std::vector<ChunkRLEEntry> encoded;
         uint8_t current_value = getter(_tiles[0][0]);
         uint32_t current_count = 1;
@@ -202,7 +512,7 @@ class Chunk {
     }
 
     template<typename FieldGetter>
-    void _serialize_field_sparse(std::ofstream& file, FieldGetter getter) const {
+    void _serialize_field_sparse(std::ostream& file, FieldGetter getter) const {
         std::vector<ChunkSparseEntry> sparse_data;
         for (int y = 0; y < CHUNK_HEIGHT; y++)
             for (int x = 0; x < CHUNK_WIDTH; x++) {
@@ -221,7 +531,7 @@ class Chunk {
 
     // Generic field serializer that chooses compression method based on efficiency
     template<typename FieldGetter>
-    uint32_t _serialize_field(std::ofstream& file, FieldGetter getter, uint32_t rle_flag, uint32_t sparse_flag) const {
+    uint32_t _serialize_field(std::ostream& file, FieldGetter getter, uint32_t rle_flag, uint32_t sparse_flag) const {
         auto [rle_size, sparse_size] = _calculate_compression_efficiency(getter);
         if (rle_size <= sparse_size) {
             _serialize_field_rle(file, getter);
@@ -233,7 +543,7 @@ class Chunk {
     }
 
     template<typename FieldSetter>
-    void _deserialize_field_rle(std::ifstream& file, FieldSetter setter) {
+    void _deserialize_field_rle(std::istream& file, FieldSetter setter) {
         uint32_t count;
         file.read(reinterpret_cast<char*>(&count), sizeof(count));
         
@@ -250,7 +560,7 @@ class Chunk {
     }
 
     template<typename FieldSetter>
-    void _deserialize_field_sparse(std::ifstream& file, FieldSetter setter) {
+    void _deserialize_field_sparse(std::istream& file, FieldSetter setter) {
         uint32_t count;
         file.read(reinterpret_cast<char*>(&count), sizeof(count));
         for (uint32_t i = 0; i < count; ++i) {
@@ -266,14 +576,14 @@ class Chunk {
 
     // Generic field deserializer that chooses method based on flags
     template<typename FieldSetter>
-    void _deserialize_field(std::ifstream& file, FieldSetter setter, uint32_t flags, uint32_t rle_flag) {
+    void _deserialize_field(std::istream& file, FieldSetter setter, uint32_t flags, uint32_t rle_flag) {
         if (flags & rle_flag)
             _deserialize_field_rle(file, setter);
         else
             _deserialize_field_sparse(file, setter);
     }
 
-    void _serialize(std::ofstream& file) const {
+    void _serialize(std::ostream& file) const {
         uint32_t flags = 0;
         auto flags_pos = file.tellp();
         file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
@@ -290,13 +600,309 @@ class Chunk {
         file.seekp(end_pos);
     }
     
-    void _deserialize(std::ifstream& file, uint32_t flags) {
+    // Bounds-checked cursor over serialized chunk bytes, e.g. a mapped region file
+    struct ChunkReader {
+        const uint8_t *data;
+        size_t length;
+        size_t offset = 0;
+
+        template<typename T>
+        T read() {
+            if (offset + sizeof(T) > length)
+                throw std::runtime_error("Invalid chunk data (truncated)");
+            T value;
+            memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+
+        uint32_t varint() {
+            uint32_t value = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                uint8_t byte = read<uint8_t>();
+                value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            throw std::runtime_error("Invalid chunk data (bad varint)");
+        }
+    };
+
+    // Decode one field into a row-major plane, runs are filled with memset instead of tile by tile
+    static void _decode_plane_v1(ChunkReader &reader, uint8_t *plane, bool rle) {
+        uint32_t count = reader.read<uint32_t>();
+        if (rle) {
+            size_t tile = 0;
+            for (uint32_t i = 0; i < count && tile < CHUNK_SIZE; i++) {
+                ChunkRLEEntry entry = reader.read<ChunkRLEEntry>();
+                size_t run = std::min<size_t>(entry.count, CHUNK_SIZE - tile);
+                memset(plane + tile, entry.value, run);
+                tile += run;
+            }
+            memset(plane + tile, 0, CHUNK_SIZE - tile);
+        } else {
+            memset(plane, 0, CHUNK_SIZE);
+            for (uint32_t i = 0; i < count; i++) {
+                ChunkSparseEntry entry = reader.read<ChunkSparseEntry>();
+                if (entry.index < CHUNK_SIZE)
+                    plane[entry.index] = entry.value;
+            }
+        }
+    }
+
+    // Version 2 stores each field as a plane with its own codec, packed 2 bits per field into the header flags
+    // Solid is only ever 0 or 1 so it's stored as a bit plane
+    enum ChunkPlaneCodec : uint32_t {
+        PLANE_UNIFORM = 0, // One value for the whole chunk
+        PLANE_RLE = 1,     // Varint run lengths, bit planes store the first value then alternate
+        PLANE_SPARSE = 2,  // Varint index deltas of the non-zero tiles
+        PLANE_RAW = 3      // Every tile, 8 per byte for bit planes
+    };
+
+    static void _put_varint(std::string &out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // FNV-1a
+    static uint32_t _checksum(const uint8_t *data, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // Encode a row-major plane with every codec and keep the smallest
+    static uint32_t _encode_plane_v2(const uint8_t *plane, bool bits, std::string &out) {
+        if (std::all_of(plane, plane + CHUNK_SIZE, [&](uint8_t v) { return v == plane[0]; })) {
+            out.push_back(static_cast<char>(plane[0]));
+            return PLANE_UNIFORM;
+        }
+
+        std::string rle;
+        std::string runs;
+        uint32_t run_count = 0;
+        if (bits)
+            rle.push_back(static_cast<char>(plane[0]));
+        for (size_t i = 0; i < CHUNK_SIZE;) {
+            size_t j = i + 1;
+            while (j < CHUNK_SIZE && plane[j] == plane[i])
+                j++;
+            if (!bits)
+                runs.push_back(static_cast<char>(plane[i]));
+            _put_varint(runs, static_cast<uint32_t>(j - i));
+            run_count++;
+            i = j;
+        }
+        _put_varint(rle, run_count);
+        rle += runs;
+
+        std::string sparse;
+        std::string entries;
+        uint32_t sparse_count = 0;
+        size_t last = 0;
+        for (size_t i = 0; i < CHUNK_SIZE; i++)
+            if (plane[i] != 0) {
+                _put_varint(entries, static_cast<uint32_t>(i - last));
+                if (!bits)
+                    entries.push_back(static_cast<char>(plane[i]));
+                last = i;
+                sparse_count++;
+            }
+        _put_varint(sparse, sparse_count);
+        sparse += entries;
+
+        size_t raw_size = bits ? CHUNK_SIZE / 8 : CHUNK_SIZE;
+        if (raw_size <= rle.size() && raw_size <= sparse.size()) {
+            if (bits) {
+                for (size_t i = 0; i < CHUNK_SIZE; i += 8) {
+                    uint8_t byte = 0;
+                    for (int b = 0; b < 8; b++)
+                        byte |= (plane[i + b] ? 1 : 0) << b;
+                    out.push_back(static_cast<char>(byte));
+                }
+            } else
+                out.append(reinterpret_cast<const char*>(plane), CHUNK_SIZE);
+            return PLANE_RAW;
+        }
+        if (rle.size() <= sparse.size()) {
+            out += rle;
+            return PLANE_RLE;
+        }
+        out += sparse;
+        return PLANE_SPARSE;
+    }
+
+    static void _decode_plane_v2(ChunkReader &reader, uint8_t *plane, uint32_t codec, bool bits) {
+        switch (codec) {
+            case PLANE_UNIFORM:
+                memset(plane, reader.read<uint8_t>(), CHUNK_SIZE);
+                break;
+            case PLANE_RLE: {
+                uint8_t value = bits ? reader.read<uint8_t>() : 0;
+                uint32_t count = reader.varint();
+                size_t tile = 0;
+                for (uint32_t i = 0; i < count && tile < CHUNK_SIZE; i++) {
+                    if (!bits)
+                        value = reader.read<uint8_t>();
+                    size_t run = std::min<size_t>(reader.varint(), CHUNK_SIZE - tile);
+                    memset(plane + tile, value, run);
+                    tile += run;
+                    if (bits)
+                        value = !value;
+                }
+                memset(plane + tile, 0, CHUNK_SIZE - tile);
+                break;
+            }
+            case PLANE_SPARSE: {
+                memset(plane, 0, CHUNK_SIZE);
+                uint32_t count = reader.varint();
+                size_t tile = 0;
+                for (uint32_t i = 0; i < count; i++) {
+                    tile += reader.varint();
+                    uint8_t value = bits ? 1 : reader.read<uint8_t>();
+                    if (tile >= CHUNK_SIZE)
+                        throw std::runtime_error("Invalid chunk data (sparse index out of range)");
+                    plane[tile] = value;
+                }
+                break;
+            }
+            case PLANE_RAW:
+                if (bits)
+                    for (size_t i = 0; i < CHUNK_SIZE; i += 8) {
+                        uint8_t byte = reader.read<uint8_t>();
+                        for (int b = 0; b < 8; b++)
+                            plane[i + b] = (byte >> b) & 1;
+                    }
+                else {
+                    if (reader.offset + CHUNK_SIZE > reader.length)
+                        throw std::runtime_error("Invalid chunk data (truncated)");
+                    memcpy(plane, reader.data + reader.offset, CHUNK_SIZE);
+                    reader.offset += CHUNK_SIZE;
+                }
+                break;
+        }
+    }
+
+    // Caller holds the read lock
+    void _serialize_v2(std::ostream& file) const {
+        std::unique_ptr<uint8_t[]> planes(new uint8_t[CHUNK_SIZE * 3]);
+        uint8_t *solid = planes.get();
+        uint8_t *visited = solid + CHUNK_SIZE;
+        uint8_t *extra = visited + CHUNK_SIZE;
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++) {
+                int i = y * CHUNK_WIDTH + x;
+                solid[i] = _tiles[x][y].solid ? 1 : 0;
+                visited[i] = _tiles[x][y].visited;
+                extra[i] = _tiles[x][y].extra;
+            }
+
+        std::string out(sizeof(ChunkHeader), '\0');
+        uint32_t flags = 0;
+        flags |= _encode_plane_v2(solid, true, out);
+        flags |= _encode_plane_v2(visited, false, out) << 2;
+        flags |= _encode_plane_v2(extra, false, out) << 4;
+
+        ChunkHeader header = {
+            .magic = 0x4543494E, // "NICE"
+            .version = 2,
+            .width = CHUNK_WIDTH,
+            .height = CHUNK_HEIGHT,
+            .flags = flags
+        };
+        memcpy(out.data(), &header, sizeof(ChunkHeader));
+        uint32_t checksum = _checksum(reinterpret_cast<const uint8_t*>(out.data()), out.size());
+        out.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        file.write(out.data(), out.size());
+    }
+
+    void _deserialize(std::istream& file, uint32_t flags) {
         // Deserialize each field based on flags
         _deserialize_field(file, [](Tile& t, uint8_t v) { t.solid = v; }, flags, SOLID_RLE);
         _deserialize_field(file, [](Tile& t, uint8_t v) { t.visited = v; }, flags, VISITED_RLE);
         _deserialize_field(file, [](Tile& t, uint8_t v) { t.extra = v; }, flags, EXTRA_RLE);
     }
 
+    void _modified() {
+        _is_generated.store(false);
+        _revision++;
+    }
+
+    static constexpr int _overview_width = CHUNK_WIDTH / CHUNK_OVERVIEW_SCALE;
+    static constexpr int _overview_height = CHUNK_HEIGHT / CHUNK_OVERVIEW_SCALE;
+    static_assert(CHUNK_WIDTH % CHUNK_OVERVIEW_SCALE == 0 && CHUNK_HEIGHT % CHUNK_OVERVIEW_SCALE == 0,
+                  "CHUNK_OVERVIEW_SCALE has to divide the chunk size");
+
+    // Same rules as VertexBatch, never made images are skipped without asking sokol
+    static bool _image_valid(sg_image image) {
+        return image.id != SG_INVALID_ID && sg_query_image_state(image) == SG_RESOURCESTATE_VALID;
+    }
+
+    static void _release_image(sg_image &image) {
+        if (_image_valid(image))
+            sg_destroy_image(image);
+        image = {SG_INVALID_ID};
+    }
+
+    // Made again rather than updated, sokol only allows one update per image per frame
+    static void _make_tile_image(sg_image &image, int width, int height, std::unique_ptr<uint8_t[]> &texels) {
+        _release_image(image);
+        sg_image_desc desc = {
+            .width = width,
+            .height = height,
+            .pixel_format = SG_PIXELFORMAT_RG8
+        };
+        desc.data.subimage[0][0] = {
+            .ptr = texels.get(),
+            .size = static_cast<size_t>(width * height * 2)
+        };
+        image = sg_make_image(&desc);
+        texels.reset();
+    }
+
+    // One quad over a tile image with the tilemap pipeline, the image can be any resolution
+    void _draw_tiles(sg_image tiles) {
+        sg_bindings bind = {};
+        _texture->bind(bind);
+        bind.images[IMG_tiles] = tiles;
+        bind.samplers[SMP_tiles_smp] = *_texture;
+        sg_apply_bindings(&bind);
+        tilemap_vs_params_t vs_params = {
+            .mvp = _mvp,
+            .size = glm::vec2(CHUNK_WIDTH * TILE_WIDTH, CHUNK_HEIGHT * TILE_HEIGHT)
+        };
+        sg_apply_uniforms(UB_tilemap_vs_params, SG_RANGE(vs_params));
+        float iw = 1.f / _texture->width(), ih = 1.f / _texture->height();
+        tilemap_fs_params_t fs_params = {
+            .cell_size = glm::vec2(TILE_ORIGINAL_WIDTH * iw, TILE_ORIGINAL_HEIGHT * ih),
+            .cell_stride = glm::vec2((TILE_ORIGINAL_WIDTH + TILE_PADDING) * iw, (TILE_ORIGINAL_HEIGHT + TILE_PADDING) * ih),
+            .padding = glm::vec2(TILE_PADDING * iw, TILE_PADDING * ih)
+        };
+        sg_apply_uniforms(UB_tilemap_fs_params, SG_RANGE(fs_params));
+        sg_draw(0, 6, 1);
+    }
+
+    template<typename FieldRef>
+    bool _set_field(int tx, int ty, FieldRef field, uint8_t value, bool generating = false) {
+        if (tx < 0 || tx >= CHUNK_WIDTH || ty < 0 || ty >= CHUNK_HEIGHT || !is_filled())
+            return false;
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        uint8_t &current = field(_tiles[tx][ty]);
+        if (current == value)
+            return false;
+        current = value;
+        if (!generating)
+            _modified();
+        return true;
+    }
+
 public:
     Chunk(int x, int y, Camera *camera, Texture *texture)
         : _camera(camera)
@@ -304,28 +910,158 @@ public:
         , _x(x)
         , _y(y) {
         _batch.set_texture(texture);
+        memset(&_halo, 1, sizeof(_halo));
     };
 
-    bool fill() {
-        if (is_filled())
+    // First stage, the noise the caves are smoothed out of
+    bool generate_terrain(uint64_t seed) {
+        if (_stage.load() != ChunkStage::Empty)
             return false;
 
         std::unique_lock<std::mutex> write_lock(_write_mutex);
+        _terrain = std::make_unique<uint64_t[][_terrain_words]>(_terrain_height + 2);
+        for (int w = 0; w < _terrain_words; w++)
+            _terrain[0][w] = _terrain[_terrain_height + 1][w] = ~0ULL;
+        int64_t ox = static_cast<int64_t>(_x) * CHUNK_WIDTH - _margin;
+        int64_t oy = static_cast<int64_t>(_y) * CHUNK_HEIGHT - _margin;
+        for (int y = 0; y < _terrain_height; y++)
+            for (int w = 0; w < _terrain_words; w++) {
+                uint64_t bits = ~0ULL; // Bits past the last column stay set
+                for (int b = 0; b < 64 && w * 64 + b < _terrain_width; b++)
+                    if (_tile_noise(seed, ox + w * 64 + b, oy + y) % 100 >= CHUNK_FILL_CHANCE)
+                        bits &= ~(1ULL << b);
+                _terrain[y + 1][w] = bits;
+            }
+        _stage.store(ChunkStage::Terrain);
+        return true;
+    }
 
-        uint8_t _grid[CHUNK_SIZE];
-        memset(_grid, 0, CHUNK_SIZE * sizeof(uint8_t));
-        for (int y = 0; y < CHUNK_HEIGHT; y++)
-            for (int x = 0; x < CHUNK_WIDTH; x++)
-                _tiles[x][y].solid = x == 0 || y == 0 || x == CHUNK_WIDTH - 1 || y == CHUNK_HEIGHT - 1 ? 1 : _grid[y * CHUNK_WIDTH + x];
-        for (int y = 0; y < CHUNK_HEIGHT; y++)
-            for (int x = 0; x < CHUNK_WIDTH; x++)
-                _tiles[x][y].bitmask = _tiles[x][y].solid ? tile_bitmask(this, x, y, 1) : 0;
+    // Run the cave automaton over the terrain and fill in the tiles, the chunk is usable after this
+    bool smooth() {
+        if (_stage.load() != ChunkStage::Terrain)
+            return false;
 
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        _smooth<_terrain_width, _terrain_height>(_terrain.get(), CHUNK_SMOOTH_ITERATIONS);
+        auto solid = [&](int x, int y) -> uint8_t {
+            x += _margin;
+            y += _margin + 1;
+            return (_terrain[y][x / 64] >> (x % 64)) & 1;
+        };
+        for (int x = 0; x < CHUNK_WIDTH; x++)
+            for (int y = 0; y < CHUNK_HEIGHT; y++)
+                _tiles[x][y].solid = solid(x, y);
+        _each_halo_tile([&](int x, int y, uint8_t &tile) {
+            tile = solid(x, y);
+        });
+        _terrain.reset();
+        _calculate_bitmasks();
+
+        _is_generated.store(true);
         _is_filled.store(true);
+        _stage.store(ChunkStage::Smoothed);
         return true;
     }
 
-    std::pair<ChunkVertex*, size_t> vertices() {
+    // Terrain and smoothing in one go
+    // Same seed and coordinates always give the same chunk, so generated chunks never need saving
+    bool fill(uint64_t seed) {
+        if (is_filled())
+            return false;
+        return generate_terrain(seed) && smooth();
+    }
+
+    // Copy this chunk's solid tiles into the surroundings of the chunk dx, dy chunks away
+    void copy_surroundings(int dx, int dy, ChunkSurroundings &area) const {
+        if (!is_filled())
+            return;
+        int ox = dx * CHUNK_WIDTH, oy = dy * CHUNK_HEIGHT;
+        int x0 = std::max(-ChunkSurroundings::margin - ox, 0);
+        int x1 = std::min(CHUNK_WIDTH + ChunkSurroundings::margin - ox, CHUNK_WIDTH);
+        int y0 = std::max(-ChunkSurroundings::margin - oy, 0);
+        int y1 = std::min(CHUNK_HEIGHT + ChunkSurroundings::margin - oy, CHUNK_HEIGHT);
+        std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        for (int x = x0; x < x1; x++)
+            for (int y = y0; y < y1; y++)
+                area.solid[(ox + x + ChunkSurroundings::margin) * ChunkSurroundings::height + oy + y + ChunkSurroundings::margin] = _tiles[x][y].solid;
+        if (!is_generated())
+            area.generated = false;
+    }
+
+    // Decorations go on empty tiles with solid ground underneath, spaced out with _poisson_disc()
+    // Points near the edges are weighed against the ones in the neighbours, so area has to hold
+    // the neighbours' tiles. Anything placed from edited tiles can't be regenerated, so it's saved.
+    bool decorate(uint64_t seed, const ChunkSurroundings &area) {
+        if (_stage.load() != ChunkStage::Smoothed)
+            return false;
+
+        int64_t ox = static_cast<int64_t>(_x) * CHUNK_WIDTH;
+        int64_t oy = static_cast<int64_t>(_y) * CHUNK_HEIGHT;
+        auto points = _poisson_disc(_splitmix64(seed ^ static_cast<uint64_t>(ChunkStage::Decorated)), ox, oy,
+                                    CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_DECORATION_RADIUS, [&](int64_t x, int64_t y) {
+            int lx = static_cast<int>(x - ox), ly = static_cast<int>(y - oy);
+            return !area.at(lx, ly) && area.at(lx, ly + 1);
+        });
+
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        for (auto [x, y] : points)
+            _tiles[x][y].extra = TILE_EXTRA_DECORATION;
+        if (!points.empty() && (!is_generated() || !area.generated))
+            _modified();
+        _stage.store(ChunkStage::Decorated);
+        return true;
+    }
+
+    // At most one spawn point in every CHUNK_SPAWN_SPACING square of the world, on open ground
+    bool seed_entities(uint64_t seed) {
+        if (_stage.load() != ChunkStage::Decorated)
+            return false;
+
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        uint64_t spawn_seed = _splitmix64(seed ^ static_cast<uint64_t>(ChunkStage::Seeded));
+        int64_t ox = static_cast<int64_t>(_x) * CHUNK_WIDTH;
+        int64_t oy = static_cast<int64_t>(_y) * CHUNK_HEIGHT;
+        bool changed = false;
+        for (int64_t cx = _floor_div(ox, CHUNK_SPAWN_SPACING); cx * CHUNK_SPAWN_SPACING < ox + CHUNK_WIDTH; cx++)
+            for (int64_t cy = _floor_div(oy, CHUNK_SPAWN_SPACING); cy * CHUNK_SPAWN_SPACING < oy + CHUNK_HEIGHT; cy++) {
+                uint64_t noise = _tile_noise(spawn_seed, cx, cy);
+                int64_t x = cx * CHUNK_SPAWN_SPACING + static_cast<int64_t>(noise % CHUNK_SPAWN_SPACING) - ox;
+                int64_t y = cy * CHUNK_SPAWN_SPACING + static_cast<int64_t>((noise >> 32) % CHUNK_SPAWN_SPACING) - oy;
+                if (x < 0 || y < 0 || x >= CHUNK_WIDTH || y >= CHUNK_HEIGHT)
+                    continue;
+                // The bottom row is skipped, the ground under it belongs to the next chunk down
+                if (y + 1 >= CHUNK_HEIGHT)
+                    continue;
+                Tile &tile = _tiles[x][y];
+                if (tile.solid || !_tiles[x][y + 1].solid || tile.extra != TILE_EXTRA_NONE)
+                    continue;
+                tile.extra = TILE_EXTRA_SPAWN;
+                changed = true;
+            }
+        if (changed && !is_generated())
+            _modified();
+        _stage.store(ChunkStage::Seeded);
+        return true;
+    }
+
+    // Noise in [0, 1) for a world tile, the same value the generator would see for that seed
+    static double noise(uint64_t seed, int64_t tx, int64_t ty) {
+        return (_tile_noise(seed, tx, ty) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Generation seed for a world, from its id
+    static uint64_t world_seed(const std::string &id) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (char c : id) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ULL;
+        }
+        return _splitmix64(hash);
+    }
+
+    std::pair<std::unique_ptr<ChunkVertex[]>, size_t> vertices(const AutotileTable &autotile) {
         std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
         
         // First, count solid tiles to allocate the correct amount of memory
@@ -335,43 +1071,171 @@ public:
                 if (_tiles[x][y].solid)
                     solid_count++;
 
-        ChunkVertex *vertices = new ChunkVertex[solid_count * 6];
-        size_t vertex_index = 0;
+        // Written straight into place, nothing is allocated per tile
+        auto vertices = std::make_unique<ChunkVertex[]>(solid_count * 4);
+        ChunkVertex *out = vertices.get();
         for (int x = 0; x < CHUNK_WIDTH; x++)
             for (int y = 0; y < CHUNK_HEIGHT; y++) {
-                Tile *tile = &_tiles[x][y];
-                if (!tile->solid)
+                const Tile &tile = _tiles[x][y];
+                if (!tile.solid)
                     continue;
-                glm::vec2 clip = {0, 0};
-                int clip_x = static_cast<int>((clip.x * TILE_ORIGINAL_WIDTH) + ((clip.x + 1) * TILE_PADDING));
-                int clip_y = static_cast<int>((clip.y * TILE_ORIGINAL_HEIGHT) + ((clip.y + 1) * TILE_PADDING));
-                ChunkVertex *veritces = generate_quad({x * TILE_WIDTH, y * TILE_HEIGHT},
-                                                      {clip_x, clip_y});
-                std::copy(veritces, veritces + 6, &vertices[vertex_index]);
-                delete[] veritces;
-                vertex_index += 6;
+                _write_quad(out, x, y, autotile[tile.bitmask]);
+                out += 4;
             }
-        return {vertices, solid_count * 6};
+        return {std::move(vertices), solid_count * 4};
+    }
+
+    // Two triangles for each of the four vertices a tile has, enough for a chunk of solid tiles
+    // Every chunk shares one immutable buffer of these
+    static std::vector<uint32_t> quad_indices() {
+        static const uint32_t corners[] = {0, 1, 2, 2, 3, 0};
+        std::vector<uint32_t> indices(static_cast<size_t>(CHUNK_SIZE) * 6);
+        for (size_t quad = 0; quad < static_cast<size_t>(CHUNK_SIZE); quad++)
+            for (int i = 0; i < 6; i++)
+                indices[quad * 6 + i] = static_cast<uint32_t>(quad * 4 + corners[i]);
+        return indices;
     }
 
-    bool build() {
+    // One texel per tile for the tilemap shader, the atlas column + 1 and row, or zero for empty
+    std::unique_ptr<uint8_t[]> tile_texels(const AutotileTable &autotile) {
+        std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        auto texels = std::make_unique<uint8_t[]>(CHUNK_SIZE * 2);
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++) {
+                uint8_t *texel = &texels[(y * CHUNK_WIDTH + x) * 2];
+                const Tile &tile = _tiles[x][y];
+                const AutotileTable::Cell &cell = autotile[tile.bitmask];
+                texel[0] = tile.solid ? cell.column + 1 : 0;
+                texel[1] = tile.solid ? cell.row : 0;
+            }
+        return texels;
+    }
+
+    // The tile image at one texel per CHUNK_OVERVIEW_SCALE x CHUNK_OVERVIEW_SCALE tiles, for
+    // zoomed out views and anything else that wants the whole chunk small. A block is solid when
+    // at least half its tiles are, and full ones use the cell for a tile surrounded on every side
+    std::unique_ptr<uint8_t[]> overview_texels(const AutotileTable &autotile) {
+        std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        auto texels = std::make_unique<uint8_t[]>(_overview_width * _overview_height * 2);
+        for (int oy = 0; oy < _overview_height; oy++)
+            for (int ox = 0; ox < _overview_width; ox++) {
+                int solid = 0;
+                const Tile *first = nullptr;
+                for (int y = oy * CHUNK_OVERVIEW_SCALE; y < (oy + 1) * CHUNK_OVERVIEW_SCALE; y++)
+                    for (int x = ox * CHUNK_OVERVIEW_SCALE; x < (ox + 1) * CHUNK_OVERVIEW_SCALE; x++)
+                        if (_tiles[x][y].solid) {
+                            solid++;
+                            if (first == nullptr)
+                                first = &_tiles[x][y];
+                        }
+                uint8_t *texel = &texels[(oy * _overview_width + ox) * 2];
+                if (solid * 2 < CHUNK_OVERVIEW_SCALE * CHUNK_OVERVIEW_SCALE) {
+                    texel[0] = texel[1] = 0;
+                    continue;
+                }
+                const AutotileTable::Cell &cell = autotile[solid == CHUNK_OVERVIEW_SCALE * CHUNK_OVERVIEW_SCALE ? 0xFF : first->bitmask];
+                texel[0] = cell.column + 1;
+                texel[1] = cell.row;
+            }
+        return texels;
+    }
+
+    // Worker side, generate the vertices or the tile image on the CPU and keep them until upload()
+    // Either way the overview is made too
+    bool mesh(const AutotileTable &autotile, bool tilemap = false) {
         if (!is_filled())
             return false;
+        // Set first, anything that changes the tiles from here on needs another mesh
+        _stage.store(ChunkStage::Meshed);
         
-        // Get vertices while holding the read lock
-        auto [_vertices, vertex_count] = vertices();
+        if (tilemap) {
+            auto texels = tile_texels(autotile);
+            std::unique_lock<std::mutex> write_lock(_write_mutex);
+            _tile_texels = std::move(texels);
+            _pending_vertices.reset();
+            _pending_count = 0;
+        } else {
+            // Get vertices while holding the read lock
+            auto [_vertices, vertex_count] = vertices(autotile);
+            
+            // Now acquire write lock for modification
+            std::unique_lock<std::mutex> write_lock(_write_mutex);
+            _tile_texels.reset();
+            _pending_vertices = std::move(_vertices);
+            _pending_count = vertex_count;
+        }
+        auto overview = overview_texels(autotile);
+        {
+            std::unique_lock<std::mutex> write_lock(_write_mutex);
+            _overview_texels = std::move(overview);
+        }
         
-        // Now acquire write lock for modification
+        _is_meshed.store(true);
+        return true;
+    }
+
+    // Main thread only, all sokol-gfx calls have to stay on the render thread
+    // The batch drops its CPU copy once it's on the GPU
+    // Vertex meshes are drawn through indices, the buffer from quad_indices() made on the main thread
+    bool upload(sg_buffer indices) {
+        if (!is_meshed())
+            return false;
+
         std::unique_lock<std::mutex> write_lock(_write_mutex);
-        _batch.add_vertices(_vertices, vertex_count);
-        _batch.build();
+        if (_tile_texels) {
+            _make_tile_image(_tile_image, CHUNK_WIDTH, CHUNK_HEIGHT, _tile_texels);
+            _batch.release();
+            _batch.clear();
+        } else if (_pending_vertices) {
+            // Released first, an empty mesh wouldn't replace the old buffer
+            _batch.release();
+            _batch.assign(std::move(_pending_vertices), _pending_count);
+            _pending_count = 0;
+            _batch.set_index_buffer(indices);
+            _batch.build();
+            _batch.discard();
+            _release_image(_tile_image);
+        }
+        if (_overview_texels)
+            _make_tile_image(_overview_image, _overview_width, _overview_height, _overview_texels);
         write_lock.unlock();
         
-        delete[] _vertices;
         _is_built.store(true);
         return true;
     }
 
+    // Main thread only, drop the GPU buffer so the chunk can be handed off to another thread
+    void release() {
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        _batch.release();
+        _batch.clear();
+        _release_image(_tile_image);
+        _release_image(_overview_image);
+        _tile_texels.reset();
+        _overview_texels.reset();
+        _pending_vertices.reset();
+        _pending_count = 0;
+        write_lock.unlock();
+
+        _is_built.store(false);
+        _is_meshed.store(false);
+    }
+
+    // Bring back a chunk that was evicted but never freed, it still needs meshing
+    void revive() {
+        if (_stage.load() == ChunkStage::Meshed)
+            _stage.store(ChunkStage::Seeded);
+        _is_destroyed.store(false);
+        _visibility.store(ChunkVisibility::OutOfSign);
+        _rebuild_mvp.store(true);
+    }
+
+    size_t upload_size() const {
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        return (_tile_texels ? CHUNK_SIZE * 2 : 0) + (_pending_vertices ? sizeof(ChunkVertex) * _pending_count : 0) +
+               (_overview_texels ? _overview_width * _overview_height * 2 : 0);
+    }
+
     std::vector<glm::vec2> poisson(float r, int k=30, bool invert=false, bool lock = true, int max_tries=CHUNK_SIZE / 4, Rect region={0, 0, CHUNK_WIDTH, CHUNK_HEIGHT}) {
         float cell_size = r / std::sqrt(2.0f);
         int grid_width = static_cast<int>(std::ceil(CHUNK_WIDTH / cell_size));
@@ -621,9 +1485,13 @@ public:
         return path.empty() ? std::nullopt : std::optional<std::vector<glm::vec2>>(path);
     }
 
-    void draw(bool force_update = false) {
-        if (!is_ready())
-            return;
+    // Returns the number of vertices drawn, 0 if it isn't ready yet. Expects the basic pipeline
+    // applied for vertex meshes and the tilemap one for tile images, see uses_tilemap(). Overviews
+    // are always drawn with the tilemap pipeline
+    size_t draw(bool force_update = false, bool overview = false) {
+        sg_image tiles = overview ? _overview_image : _tile_image;
+        if (!is_ready() || (!_image_valid(tiles) && (overview || !_batch.is_ready())))
+            return 0;
 
         if (_rebuild_mvp.load() || force_update) {
             _mvp = glm::translate(_camera->matrix(),
@@ -634,10 +1502,25 @@ public:
         }
 
         std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        if (_image_valid(tiles)) {
+            _draw_tiles(tiles);
+            return 6;
+        }
         vs_params_t vs_params = { .mvp = _mvp };
         sg_range params = SG_RANGE(vs_params);
         sg_apply_uniforms(UB_vs_params, &params);
-        _batch.flush();
+        _batch.flush_indexed(_batch.count() / 4 * 6);
+        return _batch.count();
+    }
+
+    // Whether draw() needs the tilemap pipeline, false until the chunk's been uploaded that way
+    bool uses_tilemap() const {
+        return _image_valid(_tile_image);
+    }
+
+    // The chunk's overview as a tile image, see overview_texels(). Invalid until it's uploaded
+    sg_image overview() const {
+        return _overview_image;
     }
 
     static inline std::string visibility_to_string(ChunkVisibility visibility) {
@@ -651,6 +1534,24 @@ public:
         }
     }
 
+    static const char* stage_to_string(ChunkStage stage) {
+        switch (stage) {
+            case ChunkStage::Empty:
+                return "empty";
+            case ChunkStage::Terrain:
+                return "terrain";
+            case ChunkStage::Smoothed:
+                return "smooth";
+            case ChunkStage::Decorated:
+                return "decorate";
+            case ChunkStage::Seeded:
+                return "seed";
+            case ChunkStage::Meshed:
+                return "mesh";
+        }
+        return "unknown";
+    }
+
     static Rect bounds(int _x, int _y) {
         return Rect(_x * CHUNK_WIDTH * TILE_WIDTH,
                     _y * CHUNK_HEIGHT * TILE_HEIGHT,
@@ -678,6 +1579,10 @@ public:
         return _is_filled.load();
     }
 
+    bool is_meshed() const {
+        return _is_meshed.load();
+    }
+
     bool is_built() const {
         return _is_built.load();
     }
@@ -697,9 +1602,124 @@ public:
     ChunkVisibility visibility() const {
         return _visibility.load();
     }
+
+    // Main thread only, asks sokol whether the GPU side still exists
+    ChunkMemoryStats memory_stats() const {
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        ChunkMemoryStats stats;
+        stats.tile_bytes = sizeof(_tiles);
+        stats.vertex_count = _batch.count();
+        size_t overview_bytes = _overview_width * _overview_height * 2;
+        stats.cpu_vertex_bytes = _batch.cpu_bytes() + (_tile_texels ? CHUNK_SIZE * 2 : 0) +
+                                 (_pending_vertices ? sizeof(ChunkVertex) * _pending_count : 0) +
+                                 (_overview_texels ? overview_bytes : 0);
+        stats.gpu_vertex_bytes = _batch.gpu_bytes() + (_image_valid(_tile_image) ? CHUNK_SIZE * 2 : 0) +
+                                 (_image_valid(_overview_image) ? overview_bytes : 0);
+        return stats;
+    }
     
     void set_visibility(ChunkVisibility visibility) {
-        _visibility.store(visibility);
+        // Only visible chunks are drawn, so the matrix went stale while it was off screen
+        if (_visibility.exchange(visibility) != visibility && visibility == ChunkVisibility::Visible)
+            _rebuild_mvp.store(true);
+    }
+
+    // Returns true if the tile changed, solid changes also update the neighbouring bitmasks
+    // Writes made while generating are reproduced from the seed, so they don't mark the chunk modified
+    bool set_solid(int tx, int ty, bool solid, bool generating = false) {
+        if (tx < 0 || tx >= CHUNK_WIDTH || ty < 0 || ty >= CHUNK_HEIGHT || !is_filled())
+            return false;
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        if ((_tiles[tx][ty].solid != 0) == solid)
+            return false;
+        _tiles[tx][ty].solid = solid ? 1 : 0;
+        for (int y = std::max(ty - 1, 0); y <= std::min(ty + 1, CHUNK_HEIGHT - 1); y++)
+            for (int x = std::max(tx - 1, 0); x <= std::min(tx + 1, CHUNK_WIDTH - 1); x++)
+                _tiles[x][y].bitmask = _tiles[x][y].solid ? tile_bitmask(this, x, y) : 0;
+        if (!generating)
+            _modified();
+        return true;
+    }
+
+    bool set_visited(int tx, int ty, uint8_t value) {
+        return _set_field(tx, ty, [](Tile &t) -> uint8_t& { return t.visited; }, value);
+    }
+
+    bool set_extra(int tx, int ty, uint8_t value, bool generating = false) {
+        return _set_field(tx, ty, [](Tile &t) -> uint8_t& { return t.extra; }, value, generating);
+    }
+
+    // Recompute every tile's bitmask, scalar is the one tile at a time reference version
+    void recalculate_bitmasks(bool scalar = false) {
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        if (scalar)
+            _calculate_bitmasks_scalar();
+        else
+            _calculate_bitmasks();
+    }
+
+    // Copy a resident neighbour's tiles into the halo, dx and dy are its offset in chunks
+    // Returns true if any edge tile's bitmask changed and the chunk needs meshing again
+    bool link_neighbour(int dx, int dy, const Chunk &neighbour) {
+        if (!is_filled() || !neighbour.is_filled())
+            return false;
+        std::vector<std::pair<uint8_t*, uint8_t>> updates;
+        {
+            std::shared_lock<std::shared_mutex> read_lock(neighbour._read_mutex);
+            _each_halo_tile([&](int x, int y, uint8_t &tile) {
+                int nx = x - dx * CHUNK_WIDTH, ny = y - dy * CHUNK_HEIGHT;
+                if (nx >= 0 && ny >= 0 && nx < CHUNK_WIDTH && ny < CHUNK_HEIGHT)
+                    updates.push_back({&tile, neighbour._tiles[nx][ny].solid});
+            });
+        }
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        std::unique_lock<std::shared_mutex> read_lock(_read_mutex);
+        bool changed = false;
+        for (auto [tile, solid] : updates) {
+            changed |= *tile != solid;
+            *tile = solid;
+        }
+        return changed && _calculate_edge_bitmasks();
+    }
+
+    std::optional<Tile> tile(int tx, int ty) const {
+        if (tx < 0 || tx >= CHUNK_WIDTH || ty < 0 || ty >= CHUNK_HEIGHT || !is_filled())
+            return std::nullopt;
+        std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        return _tiles[tx][ty];
+    }
+
+    uint64_t revision() const {
+        return _revision.load();
+    }
+
+    void mark_saved(uint64_t revision) {
+        _saved_revision.store(revision);
+    }
+
+    bool is_generated() const {
+        return _is_generated.load();
+    }
+
+    ChunkStage stage() const {
+        return _stage.load();
+    }
+
+    // For chunks restored from a copy of generator output, e.g. the chunk cache
+    void mark_generated() {
+        _is_generated.store(true);
+    }
+
+    // For chunks restored from a copy that never made it to disk, so they're saved again
+    void mark_unsaved() {
+        _saved_revision.store(_revision.load() - 1);
+    }
+
+    // Generator output is never written, it comes back from the seed
+    bool needs_save() const {
+        return is_filled() && !is_generated() && _revision.load() != _saved_revision.load();
     }
 
     bool is_walkable(int tx, int ty, bool lock=true) const {
@@ -710,51 +1730,70 @@ public:
         return !_tiles[tx][ty].solid;
     }
 
-    bool serialize(const char *path) const {
+    bool serialize(std::ostream &file, uint32_t version = CHUNK_FORMAT_VERSION) const {
         if (!_is_filled.load())
             return false;
 
         // Acquire shared lock to prevent modifications during serialization
         std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
 
-        std::ofstream file(path, std::ios::binary);
-        if (!file)
-            throw std::runtime_error(fmt::format("Failed to open file for writing: {}", path));
-
-        ChunkHeader header = {
-            .magic = 0x4543494E, // "NICE"
-            .version = 1,        // Optimized RLE format
-            .width = CHUNK_WIDTH,
-            .height = CHUNK_HEIGHT,
-            .flags = 0           // Will be written by _serialize
-        };
-        file.write(reinterpret_cast<const char*>(&header), sizeof(ChunkHeader));
-
         try {
-            _serialize(file);
+            if (version == 2)
+                _serialize_v2(file);
+            else {
+                ChunkHeader header = {
+                    .magic = 0x4543494E, // "NICE"
+                    .version = 1,        // Optimized RLE format
+                    .width = CHUNK_WIDTH,
+                    .height = CHUNK_HEIGHT,
+                    .flags = 0           // Will be written by _serialize
+                };
+                file.write(reinterpret_cast<const char*>(&header), sizeof(ChunkHeader));
+                _serialize(file);
+            }
         } catch (const std::exception &e) {
             throw std::runtime_error(std::string("Failed to serialize chunk: ") + e.what());
         }
+        if (!file)
+            throw std::runtime_error("Failed to serialize chunk: stream error");
         return true;
     }
 
-    void deserialize(const char *path) {
-        // Acquire unique lock to prevent other operations during deserialization
-        std::unique_lock<std::mutex> write_lock(_write_mutex);
+    // Serialized bytes in the current format, empty if the chunk isn't filled
+    std::string encode() const {
+        std::ostringstream stream;
+        return serialize(stream) ? stream.str() : std::string();
+    }
 
-        std::ifstream file(path, std::ios::binary);
+    bool serialize(const char *path) const {
+        std::ofstream file(path, std::ios::binary);
         if (!file)
-            throw std::runtime_error(fmt::format("Failed to open file for reading: {}", path));
+            throw std::runtime_error(fmt::format("Failed to open file for writing: {}", path));
+        return serialize(file);
+    }
 
+    void deserialize(std::istream &file) {
         ChunkHeader header;
         file.read(reinterpret_cast<char*>(&header), sizeof(ChunkHeader));
+        if (!file)
+            throw std::runtime_error("Invalid chunk data (truncated header)");
         if (header.magic != 0x4543494E) // "NICE"
             throw std::runtime_error("Invalid chunk data (bad magic)");
+        if (header.version == 2) {
+            // Checksummed as a whole, so read the rest in and decode from memory
+            std::string data(reinterpret_cast<const char*>(&header), sizeof(ChunkHeader));
+            data.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            deserialize(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+            return;
+        }
         if (header.version != 1)
             throw std::runtime_error("Unsupported chunk version");
         if (header.width != CHUNK_WIDTH || header.height != CHUNK_HEIGHT)
             throw std::runtime_error("Chunk size mismatch");
 
+        // Acquire unique lock to prevent other operations during deserialization
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+
         try {
             memset(_tiles, 0, sizeof(_tiles));
             
@@ -764,16 +1803,84 @@ public:
             _deserialize(file, flags);
             
             // Recalculate bitmasks after deserialization
-            for (int y = 0; y < CHUNK_HEIGHT; y++)
-                for (int x = 0; x < CHUNK_WIDTH; x++)
-                    _tiles[x][y].bitmask = _tiles[x][y].solid ? tile_bitmask(this, x, y, 1) : 0;
+            _calculate_bitmasks();
             
+            _is_generated.store(false);
+            _saved_revision.store(_revision.load());
             _is_filled.store(true);
+            _stage.store(ChunkStage::Seeded);
         } catch (const std::exception &e) {
             throw std::runtime_error(std::string("Failed to deserialize chunk: ") + e.what());
         }
     }
 
+    // Decode straight from memory (e.g. a mapped region file) without going through a stream
+    void deserialize(const uint8_t *data, size_t length) {
+        ChunkReader reader = {data, length};
+        ChunkHeader header = reader.read<ChunkHeader>();
+        if (header.magic != 0x4543494E) // "NICE"
+            throw std::runtime_error("Invalid chunk data (bad magic)");
+        if (header.version != 1 && header.version != 2)
+            throw std::runtime_error("Unsupported chunk version");
+        if (header.width != CHUNK_WIDTH || header.height != CHUNK_HEIGHT)
+            throw std::runtime_error("Chunk size mismatch");
+
+        std::unique_ptr<uint8_t[]> planes(new uint8_t[CHUNK_SIZE * 3]);
+        uint8_t *solid = planes.get();
+        uint8_t *visited = solid + CHUNK_SIZE;
+        uint8_t *extra = visited + CHUNK_SIZE;
+        if (header.version == 1) {
+            uint32_t flags = reader.read<uint32_t>();
+            _decode_plane_v1(reader, solid, flags & SOLID_RLE);
+            _decode_plane_v1(reader, visited, flags & VISITED_RLE);
+            _decode_plane_v1(reader, extra, flags & EXTRA_RLE);
+        } else {
+            if (length < sizeof(ChunkHeader) + sizeof(uint32_t))
+                throw std::runtime_error("Invalid chunk data (truncated)");
+            uint32_t checksum;
+            memcpy(&checksum, data + length - sizeof(uint32_t), sizeof(uint32_t));
+            if (checksum != _checksum(data, length - sizeof(uint32_t)))
+                throw std::runtime_error("Invalid chunk data (checksum mismatch)");
+            reader.length -= sizeof(uint32_t);
+            _decode_plane_v2(reader, solid, header.flags & 3, true);
+            _decode_plane_v2(reader, visited, (header.flags >> 2) & 3, false);
+            _decode_plane_v2(reader, extra, (header.flags >> 4) & 3, false);
+        }
+
+        std::unique_lock<std::mutex> write_lock(_write_mutex);
+        for (int y = 0; y < CHUNK_HEIGHT; y++)
+            for (int x = 0; x < CHUNK_WIDTH; x++) {
+                int i = y * CHUNK_WIDTH + x;
+                Tile &tile = _tiles[x][y];
+                tile.solid = solid[i];
+                tile.visited = visited[i];
+                tile.extra = extra[i];
+            }
+        _calculate_bitmasks();
+        _is_generated.store(false);
+        _saved_revision.store(_revision.load());
+        _is_filled.store(true);
+        _stage.store(ChunkStage::Seeded);
+    }
+
+    void deserialize(const char *path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error(fmt::format("Failed to open file for reading: {}", path));
+        deserialize(file);
+    }
+
+    // Tiles seed_entities() marked, for scripts to spawn things on
+    std::vector<std::pair<int, int>> spawn_points() const {
+        std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
+        std::vector<std::pair<int, int>> points;
+        for (int x = 0; x < CHUNK_WIDTH; x++)
+            for (int y = 0; y < CHUNK_HEIGHT; y++)
+                if (_tiles[x][y].extra == TILE_EXTRA_SPAWN)
+                    points.emplace_back(x, y);
+        return points;
+    }
+
     std::optional<std::pair<int, int>> random_walkable_tile(bool lock=true) const {
         if (lock)
             std::shared_lock<std::shared_mutex> read_lock(_read_mutex);
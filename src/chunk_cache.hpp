@@ -0,0 +1,138 @@
+//
+//  chunk_cache.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+struct ChunkCacheStats {
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// Recently evicted chunks kept in RAM in their serialized (compressed) form
+// Sits between live chunks and the region files, least recently used entries are
+// dropped once the byte budget is exceeded. Entries are always at least as new as
+// what's on disk, so dropping one never loses anything. The exception is a chunk whose
+// region write failed, it stays dirty and is kept past the budget until it's restored.
+class ChunkCache {
+    struct Entry {
+        uint64_t id;
+        std::string data;
+        bool generated; // Untouched generator output, restored as such so it's never saved
+        bool dirty;     // Not on disk yet, restored as unsaved so it's written again
+    };
+
+    std::list<Entry> _entries; // Most recently used at the front
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _lookup;
+    size_t _bytes = 0;
+    size_t _budget;
+    mutable std::mutex _mutex;
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+
+    void erase(std::list<Entry>::iterator it) {
+        _bytes -= it->data.size();
+        _lookup.erase(it->id);
+        _entries.erase(it);
+    }
+
+    void trim() {
+        for (auto it = _entries.end(); _bytes > _budget && it != _entries.begin();) {
+            if ((--it)->dirty)
+                continue;
+            erase(it++);
+            _evictions++;
+        }
+    }
+
+public:
+    ChunkCache(size_t budget = CHUNK_CACHE_BUDGET_BYTES): _budget(budget) {}
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    // Dirty entries are kept until mark_clean() once their region write succeeds
+    void put(uint64_t id, std::string data, bool generated, bool dirty = false) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _lookup.find(id);
+        if (it != _lookup.end())
+            erase(it->second);
+        if (data.size() > _budget && !dirty)
+            return;
+        _bytes += data.size();
+        _entries.push_front({id, std::move(data), generated, dirty});
+        _lookup[id] = _entries.begin();
+        trim();
+    }
+
+    void mark_clean(uint64_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _lookup.find(id);
+        if (it == _lookup.end() || !it->second->dirty)
+            return;
+        it->second->dirty = false;
+        trim();
+    }
+
+    // Removes the entry, the caller's live chunk replaces it
+    bool take(uint64_t id, std::string &data, bool &generated, bool &dirty) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _lookup.find(id);
+        if (it == _lookup.end()) {
+            _misses++;
+            return false;
+        }
+        auto entry = it->second;
+        _bytes -= entry->data.size();
+        data = std::move(entry->data);
+        generated = entry->generated;
+        dirty = entry->dirty;
+        _lookup.erase(it);
+        _entries.erase(entry);
+        _hits++;
+        return true;
+    }
+
+    void set_budget(size_t budget) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _budget = budget;
+        trim();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _lookup.clear();
+        _bytes = 0;
+    }
+
+    ChunkCacheStats stats() const {
+        ChunkCacheStats stats;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stats.entries = _entries.size();
+            stats.bytes = _bytes;
+            stats.budget = _budget;
+        }
+        stats.hits = _hits.load();
+        stats.misses = _misses.load();
+        stats.evictions = _evictions.load();
+        return stats;
+    }
+};
@@ -10,6 +10,15 @@
 #include "global.hpp"
 #include "chunk.hpp"
 #include "job_queue.hpp"
+#include "chunk_request_queue.hpp"
+#include "chunk_writer.hpp"
+#include "chunk_pipeline.hpp"
+#include "chunk_map.hpp"
+#include "generation_scripts.hpp"
+#include "region_file.hpp"
+#include "chunk_cache.hpp"
+#include "world_archive.hpp"
+#include "world_saver.hpp"
 #include "camera.hpp"
 #include "fmt/format.h"
 #include <unordered_map>
@@ -17,8 +26,14 @@
 #include <iostream>
 #include <filesystem>
 #include <queue>
+#include <deque>
+#include <array>
+#include <vector>
+#include <algorithm>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <chrono>
 #include "uuid.h"
 #include "sokol/sokol_time.h"
 #include "minilua.h"
@@ -36,20 +51,165 @@ struct ChunkEvent {
     ChunkVisibility new_vis = ChunkVisibility::OutOfSign;
 };
 
+struct ChunkUploadStats {
+    size_t uploaded = 0; // Chunks uploaded last frame
+    size_t bytes = 0;    // Vertex bytes uploaded last frame
+    double ms = 0.0;     // Time spent uploading last frame
+    size_t pending = 0;  // Meshes still waiting for upload
+};
+
+// Inclusive range of chunk coordinates, x1 < x0 when it's empty
+struct ChunkRange {
+    int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+
+    // Every chunk whose bounds intersect a rect in world space, the same test as Rect::intersects
+    static ChunkRange covering(const Rect &rect) {
+        ChunkRange range;
+        if (rect.w <= 0 || rect.h <= 0)
+            return range;
+        range.x0 = _floor_div(rect.x, CHUNK_WIDTH * TILE_WIDTH);
+        range.y0 = _floor_div(rect.y, CHUNK_HEIGHT * TILE_HEIGHT);
+        range.x1 = _floor_div(rect.x + rect.w - 1, CHUNK_WIDTH * TILE_WIDTH);
+        range.y1 = _floor_div(rect.y + rect.h - 1, CHUNK_HEIGHT * TILE_HEIGHT);
+        return range;
+    }
+
+    bool empty() const {
+        return x1 < x0 || y1 < y0;
+    }
+
+    bool contains(int x, int y) const {
+        return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+    }
+
+    bool operator==(const ChunkRange &other) const {
+        return (empty() && other.empty()) ||
+               (x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1);
+    }
+
+    bool operator!=(const ChunkRange &other) const {
+        return !(*this == other);
+    }
+
+    ChunkRange grown(int chunks) const {
+        if (empty())
+            return *this;
+        return {x0 - chunks, y0 - chunks, x1 + chunks, y1 + chunks};
+    }
+
+    // Call fn(x, y) for every chunk in this range that isn't in other, row by row so a camera
+    // that moved one chunk over only visits the one column that changed
+    template<typename Fn>
+    void for_each_outside(const ChunkRange &other, Fn &&fn) const {
+        if (empty())
+            return;
+        for (int y = y0; y <= y1; y++) {
+            if (other.empty() || y < other.y0 || y > other.y1) {
+                for (int x = x0; x <= x1; x++)
+                    fn(x, y);
+                continue;
+            }
+            for (int x = x0; x <= std::min(x1, other.x0 - 1); x++)
+                fn(x, y);
+            for (int x = std::max(x0, other.x1 + 1); x <= x1; x++)
+                fn(x, y);
+        }
+    }
+
+private:
+    static int _floor_div(int a, int b) {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+};
+
+// The chunks the camera can see and the ones kept loaded around it. Decorating a chunk needs
+// all 8 neighbours smoothed, so the loaded range has a ring of terrain-only chunks around it
+// that stop there and are evicted with the rest once they leave it
+struct ChunkWindow {
+    ChunkRange visible;
+    ChunkRange loaded;
+    ChunkRange terrain;
+
+    ChunkWindow() = default;
+    ChunkWindow(const Rect &camera_bounds, const Rect &max_bounds)
+        : visible(ChunkRange::covering(camera_bounds))
+        , loaded(ChunkRange::covering(max_bounds))
+        , terrain(loaded.grown(1)) {}
+
+    // max_bounds with the terrain ring, what requests are kept for
+    static Rect terrain_bounds(const Rect &max_bounds) {
+        return Rect(max_bounds.x - CHUNK_WIDTH * TILE_WIDTH, max_bounds.y - CHUNK_HEIGHT * TILE_HEIGHT,
+                    max_bounds.w + CHUNK_WIDTH * TILE_WIDTH * 2, max_bounds.h + CHUNK_HEIGHT * TILE_HEIGHT * 2);
+    }
+
+    bool operator==(const ChunkWindow &other) const {
+        return visible == other.visible && loaded == other.loaded;
+    }
+
+    bool operator!=(const ChunkWindow &other) const {
+        return !(*this == other);
+    }
+
+    ChunkVisibility visibility(int x, int y) const {
+        return !terrain.contains(x, y) ? ChunkVisibility::OutOfSign :
+               visible.contains(x, y) ? ChunkVisibility::Visible :
+               ChunkVisibility::Occluded;
+    }
+};
+
+struct ChunkDrawStats {
+    size_t draws = 0;    // Chunks drawn last frame
+    size_t vertices = 0; // Vertices submitted last frame
+    size_t culled = 0;   // Resident chunks that aren't in view
+    bool overview = false; // Zoomed out past CHUNK_OVERVIEW_ZOOM
+};
+
+struct ChunkLoadStats {
+    uint64_t mapped_loads = 0; // Chunks decoded from a mapped region file
+    double mapped_ms = 0.0;
+    uint64_t stream_loads = 0; // Chunks decoded through std::istream
+    double stream_ms = 0.0;
+};
+
 class ChunkManager: public Global<ChunkManager> {
-    std::unordered_map<uint64_t, Chunk*> _chunks;
-    mutable std::shared_mutex _chunks_lock;
-    JobQueue<std::pair<int, int>>* _create_chunk_queue;
-    UnorderedSet<uint64_t> _chunks_being_created;
-    JobQueue<Chunk*>* _build_chunk_queue;
-    UnorderedSet<uint64_t> _chunks_being_built;
-    UnorderedSet<uint64_t> _chunks_being_destroyed;
+    ChunkMap _chunks; // Every chunk and its lifecycle, hold a ChunkMap::Pin while using a chunk from it
+    ChunkRequestQueue* _create_chunk_queue = nullptr;
+    JobQueue<Chunk*>* _build_chunk_queue = nullptr;
+    ChunkPipeline* _pipeline = nullptr;
+    GenerationScripts _scripts; // generate.lua, run on the worker smoothing the chunk
+    ChunkWriter* _chunk_writer = nullptr;
+    RegionStore* _regions = nullptr;
+    ChunkCache _cache;
+    WorldArchive _archive; // Imported world, read from only when a chunk isn't in a region file
+    WorldSaver* _saver = nullptr; // Archive saved chunks are appended to
+    std::atomic<bool> _mapped_loading{CHUNK_MMAP_LOADING};
+    std::atomic<bool> _tilemap_rendering{CHUNK_TILEMAP_RENDERING};
+    std::shared_ptr<const AutotileTable> _autotile; // Swapped whole, builds keep the one they started with
+    mutable std::mutex _autotile_lock;
+    ChunkLoadStats _load_stats;
+    mutable std::mutex _load_stats_lock;
+    std::deque<uint64_t> _upload_queue;
+    mutable std::mutex _upload_queue_lock;
+    size_t _upload_budget_bytes = CHUNK_UPLOAD_BUDGET_BYTES;
+    double _upload_budget_ms = CHUNK_UPLOAD_BUDGET_MS;
+    ChunkUploadStats _upload_stats;
+    sg_buffer _quad_indices = {SG_INVALID_ID}; // Shared by every vertex mesh, made on the first upload
+    std::mutex _link_lock; // One chunk swaps edges with its neighbours at a time
     std::unordered_map<uint64_t, uint64_t> _deletion_queue;
     mutable std::shared_mutex _deletion_queue_lock;
-    
+    // Where the camera was on the last scan and visibility update, both only redo what changed since
+    ChunkWindow _scanned;
+    ChunkWindow _placed;
+    std::vector<uint64_t> _unplaced; // Filled since the last visibility update
+    std::mutex _unplaced_lock;
+    std::vector<std::pair<int, int>> _evicted; // Released since the last scan, main thread only
+    std::vector<uint64_t> _draw_list; // Visible chunks, kept by update_chunks(), main thread only
+    ChunkDrawStats _draw_stats;
+
     Camera *_camera = nullptr;
     Texture *_tilemap = nullptr;
     uuid::v4::UUID _world_id;
+    std::atomic<uint64_t> _seed{0};
     
     // Lua event handling
     lua_State *_L = nullptr;
@@ -62,17 +222,86 @@ class ChunkManager: public Global<ChunkManager> {
     
     std::string _get_world_directory() {
         std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
-        std::filesystem::path world_dir = temp_dir / _world_id.String();
-        if (!std::filesystem::exists(world_dir))
-            std::filesystem::create_directories(world_dir);
-        return world_dir.string();
+        return (temp_dir / _world_id.String()).string();
+    }
+    
+    static void _tile_to_chunk(int tx, int ty, int &cx, int &cy, int &lx, int &ly) {
+        cx = tx >= 0 ? tx / CHUNK_WIDTH : -((-tx + CHUNK_WIDTH - 1) / CHUNK_WIDTH);
+        cy = ty >= 0 ? ty / CHUNK_HEIGHT : -((-ty + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT);
+        lx = tx - cx * CHUNK_WIDTH;
+        ly = ty - cy * CHUNK_HEIGHT;
+    }
+
+    // Region files first, then the archive. Only ever called on the writer thread
+    void _save_writes(std::vector<RegionStore::Write> &writes) {
+        _regions->save(writes);
+        if (_saver)
+            for (RegionStore::Write &write : writes)
+                _saver->save(index(write.x, write.y), std::move(write.data));
+    }
+
+    // Main thread only
+    sg_buffer _quad_index_buffer() {
+        if (_quad_indices.id == SG_INVALID_ID) {
+            std::vector<uint32_t> indices = Chunk::quad_indices();
+            sg_buffer_desc desc = {
+                .data = {
+                    .ptr = indices.data(),
+                    .size = indices.size() * sizeof(uint32_t)
+                }
+            };
+            desc.usage.index_buffer = true;
+            _quad_indices = sg_make_buffer(&desc);
+        }
+        return _quad_indices;
+    }
+
+    // Build a chunk's mesh again after a change. Only once it's been meshed, otherwise the pipeline
+    // gets to it, and only one build at a time: a change while one's in flight is built after it
+    void _remesh(ChunkSlot &slot) {
+        if (_shutting_down.load() || slot.state.load() < ChunkLifecycle::Meshed)
+            return;
+        slot.remesh.store(true);
+        if (slot.advance(ChunkLifecycle::Uploaded, ChunkLifecycle::Meshed)) {
+            slot.remesh.store(false);
+            _build_chunk_queue->enqueue(slot.chunk.load());
+        }
     }
 
-    std::string _get_chunk_filepath(int x, int y) {
-        uint64_t chunk_index = index(x, y);
-        std::string filename = std::to_string(chunk_index) + ".nicechunk";
-        std::filesystem::path world_dir = _get_world_directory();
-        return (world_dir / filename).string();
+    // Filled chunks need a visibility before they can go out of range, the next update_chunks() places them
+    void _fill(Chunk *chunk) {
+        std::lock_guard<std::mutex> lock(_unplaced_lock);
+        _unplaced.push_back(chunk->id());
+    }
+
+    // Swap edges with every resident neighbour so bitmasks along the borders see real tiles
+    // Neighbours whose own edges changed are queued to be meshed again
+    void _link_neighbours(Chunk *chunk) {
+        std::lock_guard<std::mutex> link_lock(_link_lock);
+        ChunkMap::Pin pin;
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++) {
+                if (!dx && !dy)
+                    continue;
+                ChunkSlot *slot = _chunks.find_slot(index(chunk->x() + dx, chunk->y() + dy));
+                Chunk *neighbour = slot ? slot->chunk.load() : nullptr;
+                if (neighbour == nullptr || neighbour->is_destroyed())
+                    continue;
+                chunk->link_neighbour(dx, dy, *neighbour);
+                if (neighbour->link_neighbour(-dx, -dy, *chunk))
+                    _remesh(*slot);
+            }
+    }
+
+    void _record_load(bool mapped, double ms) {
+        std::lock_guard<std::mutex> lock(_load_stats_lock);
+        if (mapped) {
+            _load_stats.mapped_loads++;
+            _load_stats.mapped_ms += ms;
+        } else {
+            _load_stats.stream_loads++;
+            _load_stats.stream_ms += ms;
+        }
     }
     
     void call_lua_chunk_event(ChunkEvent::Type event_type, int x, int y, ChunkVisibility old_vis = ChunkVisibility::OutOfSign, ChunkVisibility new_vis = ChunkVisibility::OutOfSign) {
@@ -100,59 +329,108 @@ public:
     ~ChunkManager() {
         clear();
         delete _create_chunk_queue;
+        delete _pipeline;
         delete _build_chunk_queue;
+        delete _chunk_writer;
+        delete _saver;
+        delete _regions;
     }
 
     bool is_empty() const {
-        return _build_chunk_queue->empty() && _create_chunk_queue->empty() &&
-               _chunks_being_built.empty() && _chunks_being_created.empty();
+        if (!_build_chunk_queue->empty() || !_create_chunk_queue->empty() || !_pipeline->idle())
+            return false;
+        bool busy = false;
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            ChunkLifecycle state = slot.state.load();
+            busy |= state == ChunkLifecycle::Requested || state == ChunkLifecycle::Loading || state == ChunkLifecycle::Meshed;
+        });
+        return !busy;
     }
 
     void initialize(Camera *camera, Texture *tilemap, uuid::v4::UUID world_id) {
         _camera = camera;
         _tilemap = tilemap;
         _world_id = world_id;
+        _regions = new RegionStore(_get_world_directory());
+        _autotile = tilemap ? std::make_shared<const AutotileTable>(tilemap->width(), tilemap->height())
+                            : std::make_shared<const AutotileTable>();
         
         // Initialize the job queues with their callbacks
-        _create_chunk_queue = new JobQueue<std::pair<int, int>>([this](std::pair<int, int> coords) {
+        _create_chunk_queue = new ChunkRequestQueue([this](int x, int y) {
             // Skip processing if we're shutting down to avoid deadlock
             if (_shutting_down.load())
                 return;
                 
-            auto [x, y] = coords;
             uint64_t idx = index(x, y);
-            Chunk *chunk = new Chunk(x, y, _camera, _tilemap);
-            
-            // Try to load from disk first
-            std::string chunk_filepath = _get_chunk_filepath(x, y);
             bool loaded_from_disk = false;
-            if (std::filesystem::exists(chunk_filepath))
-                try {
-                    chunk->deserialize(chunk_filepath.c_str());
-                    loaded_from_disk = true;
-                    std::cout << fmt::format("Loaded chunk at ({}, {}) from {}\n", x, y, chunk_filepath);
-                } catch (const std::exception& e) {
-                    std::cout << fmt::format("Error loading chunk at ({}, {}) from {}: {}\n", x, y, chunk_filepath, e.what());
-                }
+            // Requested and Loading slots are only removed by cancelling the request or clear(),
+            // neither of which can happen while this runs, so it's safe to keep without a Pin
+            ChunkSlot *slot;
+            {
+                ChunkMap::Pin pin;
+                slot = _chunks.find_slot(idx);
+            }
+            if (slot == nullptr || !slot->advance(ChunkLifecycle::Requested, ChunkLifecycle::Loading))
+                return;
+
+            // Evicted but not written yet, take it straight back from the writer
+            Chunk *chunk = _chunk_writer->take(idx);
+            if (chunk != nullptr) {
+                chunk->revive();
+                loaded_from_disk = true;
+                std::cout << fmt::format("Reclaimed chunk at ({}, {}) from the write queue\n", x, y);
+            } else {
+                chunk = new Chunk(x, y, _camera, _tilemap);
+                // Then the compressed copies of recently evicted chunks
+                std::string cached;
+                bool generated = false, dirty = false;
+                if (_cache.take(idx, cached, generated, dirty))
+                    try {
+                        chunk->deserialize(reinterpret_cast<const uint8_t*>(cached.data()), cached.size());
+                        if (generated)
+                            chunk->mark_generated();
+                        if (dirty)
+                            chunk->mark_unsaved();
+                        loaded_from_disk = true;
+                        std::cout << fmt::format("Restored chunk at ({}, {}) from the chunk cache\n", x, y);
+                    } catch (const std::exception& e) {
+                        std::cout << fmt::format("Error restoring chunk at ({}, {}) from the chunk cache: {}\n", x, y, e.what());
+                    }
+                // Try to load from disk next
+                if (!loaded_from_disk)
+                    try {
+                        bool mapped = _mapped_loading.load();
+                        uint64_t start = stm_now();
+                        loaded_from_disk = mapped ? _regions->load_mapped(chunk) : _regions->load(chunk);
+                        if (loaded_from_disk) {
+                            double ms = stm_ms(stm_since(start));
+                            _record_load(mapped, ms);
+                            std::cout << fmt::format("Loaded chunk at ({}, {}) from region file ({}, {:.3f}ms)\n",
+                                                     x, y, mapped ? "mapped" : "stream", ms);
+                        }
+                    } catch (const std::exception& e) {
+                        std::cout << fmt::format("Error loading chunk at ({}, {}): {}\n", x, y, e.what());
+                    }
+                // Finally the imported archive, only this one entry is decompressed
+                std::string archived;
+                if (!loaded_from_disk && _archive.read(idx, archived))
+                    try {
+                        chunk->deserialize(reinterpret_cast<const uint8_t*>(archived.data()), archived.size());
+                        loaded_from_disk = true;
+                        std::cout << fmt::format("Loaded chunk at ({}, {}) from world archive\n", x, y);
+                    } catch (const std::exception& e) {
+                        std::cout << fmt::format("Error loading chunk at ({}, {}) from world archive: {}\n", x, y, e.what());
+                    }
+            }
             
-            // Check shutdown again before acquiring lock
+            // Check shutdown again before publishing it
             if (_shutting_down.load()) {
                 delete chunk;
                 return;
             }
             
-            {
-                std::unique_lock<std::shared_mutex> lock(_chunks_lock);
-                // Double-check shutdown after acquiring lock
-                if (_shutting_down.load()) {
-                    delete chunk;
-                    return;
-                }
-                std::cout << fmt::format("New chunk created at ({}, {})\n", x, y);
-                _chunks[idx] = chunk;
-                _chunks_being_created.erase(idx);  // Remove from being created set
-                _chunks_being_built.insert(idx);  // Mark as being built
-            }
+            std::cout << fmt::format("New chunk created at ({}, {})\n", x, y);
+            slot->chunk.store(chunk);
             
             // Queue chunk created event
             {
@@ -160,37 +438,112 @@ public:
                 _chunk_event_queue.push({ChunkEvent::Created, x, y});
             }
             
-            // Only fill if we didn't load from disk
-            if (!loaded_from_disk) {
-                chunk->fill();
-                std::cout << fmt::format("Chunk at ({}, {}) finished filling\n", x, y);
-                try {
-                    chunk->serialize(chunk_filepath.c_str());
-                } catch (const std::exception& e) {
-                    std::cout << fmt::format("Error saving chunk at ({}, {}) to {}: {}\n", x, y, chunk_filepath, e.what());
+            // Generated chunks start from nothing, loaded ones only have meshing left
+            // Still Loading until the pipeline has it, so it can't be evicted before. A loaded chunk
+            // is already Meshed by the time submit() returns, so that's left alone
+            if (loaded_from_disk) {
+                _fill(chunk);
+                _link_neighbours(chunk);
+            }
+            if (!_shutting_down.load())
+                _pipeline->submit(chunk);
+            slot->advance(ChunkLifecycle::Loading, ChunkLifecycle::Filled);
+        }, [this](int x, int y) {
+            // Dropped before a worker got to it, allow it to be requested again
+            std::cout << fmt::format("Chunk request at ({}, {}) cancelled, out of range\n", x, y);
+            _chunks.erase(index(x, y));
+        });
+        
+        _chunk_writer = new ChunkWriter([this](const std::vector<Chunk*> &chunks) {
+            // Every chunk is encoded once, changed ones go to disk and all of them go in the cache
+            std::vector<RegionStore::Write> writes;
+            bool caching = !_shutting_down.load();
+            for (Chunk *chunk : chunks) {
+                bool dirty = chunk->needs_save();
+                // Generator output that never got through the pipeline is cheaper to generate again
+                bool cache = caching && !(chunk->is_generated() && chunk->stage() < ChunkStage::Seeded);
+                if (!dirty && !cache) {
+                    _regions->skip();
+                    continue;
                 }
+                uint64_t revision = chunk->revision();
+                std::string data = chunk->encode();
+                // Dirty until the region write below succeeds, a copy restored before then is saved again
+                if (cache)
+                    _cache.put(chunk->id(), data, chunk->is_generated(), dirty);
+                if (dirty)
+                    writes.push_back({chunk->x(), chunk->y(), std::move(data), chunk, revision});
+                else
+                    _regions->skip();
             }
-
-            if (!_shutting_down.load() && _build_chunk_queue) {
-                _build_chunk_queue->enqueue(chunk);
-            } else {
-                delete chunk;
+            try {
+                _save_writes(writes);
+                std::cout << fmt::format("Saved {} of {} evicted chunks to region files\n", writes.size(), chunks.size());
+            } catch (const std::exception& e) {
+                std::cout << fmt::format("Error saving {} chunks to region files: {}\n", writes.size(), e.what());
             }
+            // RegionStore::save() marks each chunk saved once it's written, the rest stay dirty
+            for (const RegionStore::Write &write : writes)
+                if (!write.chunk->needs_save())
+                    _cache.mark_clean(write.chunk->id());
         });
         
         _build_chunk_queue = new JobQueue<Chunk*>([this](Chunk *chunk) {
-            // Skip processing if we're shutting down
-            if (_shutting_down.load()) {
-                delete chunk;
+            // Skip processing if we're shutting down, the map still owns it and clear() frees it
+            if (_shutting_down.load())
                 return;
-            }
             
-            chunk->build();
-            std::cout << fmt::format("Chunk at ({}, {}) finished building\n", chunk->x(), chunk->y());
+            // Only build the mesh here, the upload happens on the main thread in upload_chunks()
+            chunk->mesh(*autotile(), _tilemap_rendering.load());
+            // Only the CPU side here, memory_stats() asks sokol and that has to stay on the main thread
+            std::cout << fmt::format("Chunk at ({}, {}) finished meshing ({} KB)\n",
+                                     chunk->x(), chunk->y(), chunk->upload_size() / 1024);
+            std::lock_guard<std::mutex> lock(_upload_queue_lock);
+            _upload_queue.push_back(chunk->id());
+        });
 
-            // Remove from being built set after successful build
-            uint64_t idx = chunk->id();
-            _chunks_being_built.erase(idx);
+        _pipeline = new ChunkPipeline({
+            {ChunkStage::Terrain, ChunkStage::Empty, [this](Chunk *chunk) {
+                chunk->generate_terrain(_seed.load());
+            }},
+            {ChunkStage::Smoothed, ChunkStage::Empty, [this](Chunk *chunk) {
+                // The hook goes before the edges are shared, so neighbours see what it wrote
+                if (chunk->smooth())
+                    _scripts.run(chunk, _seed.load());
+                _fill(chunk);
+                std::cout << fmt::format("Chunk at ({}, {}) finished filling\n", chunk->x(), chunk->y());
+                _link_neighbours(chunk);
+            }},
+            // Decorations near the edges are spaced against the neighbours' ones, so they need their tiles
+            // The pipeline won't release any of them until this is done, so the area is never partial
+            {ChunkStage::Decorated, ChunkStage::Smoothed, [this](Chunk *chunk) {
+                ChunkSurroundings area;
+                {
+                    ChunkMap::Pin pin;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++)
+                            if (Chunk *neighbour = _chunks.find(index(chunk->x() + dx, chunk->y() + dy)))
+                                neighbour->copy_surroundings(dx, dy, area);
+                }
+                chunk->decorate(_seed.load(), area);
+            }},
+            {ChunkStage::Seeded, ChunkStage::Empty, [this](Chunk *chunk) {
+                chunk->seed_entities(_seed.load());
+            }}
+        }, [this](Chunk *chunk) {
+            // Called with the pipeline locked, so release_chunks() can't let go of it meanwhile
+            // It's Loading when a loaded chunk comes straight through submit(), and can't be built
+            // once it's Evicting
+            if (_shutting_down.load())
+                return;
+            ChunkMap::Pin pin;
+            ChunkSlot *slot = _chunks.find_slot(chunk->id());
+            if (slot == nullptr)
+                return;
+            ChunkLifecycle state = slot->state.load();
+            while (state != ChunkLifecycle::Evicting && !slot->state.compare_exchange_weak(state, ChunkLifecycle::Meshed));
+            if (state != ChunkLifecycle::Evicting)
+                _build_chunk_queue->enqueue(chunk);
         });
     }
     
@@ -199,46 +552,21 @@ public:
     }
     
     void get_chunk(int x, int y, std::function<void(Chunk*)> callback) {
-        Chunk* chunk = nullptr;
-        uint64_t idx = index(x, y);
-        {
-            std::shared_lock<std::shared_mutex> lock(_chunks_lock);
-            auto it = _chunks.find(idx);
-            if (it != _chunks.end())
-                if ((chunk = it->second) != nullptr && chunk->is_filled())
-                    callback(it->second);
-        }
+        ChunkMap::Pin pin;
+        Chunk *chunk = _chunks.find(index(x, y));
+        if (chunk != nullptr && chunk->is_filled())
+            callback(chunk);
     }
     
     void ensure_chunk(int x, int y, bool priority) {
         uint64_t idx = index(x, y);
 
-        // Check and insert atomically using UnorderedSet methods first
-        if (_chunks_being_created.contains(idx) ||
-            _chunks_being_built.contains(idx))
-            return;
-
-        // Try to mark as being created
-        if (!_chunks_being_created.insert(idx))
-            return; // Another thread already marked it
-
-        // Check if chunk already exists (after marking as being created to avoid race)
-        bool chunk_exists = false;
-        {
-            std::shared_lock<std::shared_mutex> chunks_lock(_chunks_lock);
-            chunk_exists = (_chunks.find(idx) != _chunks.end());
-        }
-
-        if (chunk_exists) {
-            // Chunk exists, so we don't need to create it
-            _chunks_being_created.erase(idx);
-            // Remove from deletion queue if it was there
-            {
-                std::unique_lock<std::shared_mutex> deletion_lock(_deletion_queue_lock);
-                _deletion_queue.erase(idx);
-            }
+        // Runs for every chunk in range every frame, almost always it's already there
+        // A released chunk keeps its slot until the writer has it, or the old copy could be missed
+        if (_chunks.contains(idx))
             return;
-        }
+        if (!_chunks.emplace(idx, ChunkLifecycle::Requested).second)
+            return; // Another thread got there first
 
         // Remove from deletion queue if it was there
         {
@@ -246,40 +574,43 @@ public:
             _deletion_queue.erase(idx);
         }
 
-        if (priority)
-            _create_chunk_queue->enqueue_priority({x, y});
-        else
-            _create_chunk_queue->enqueue({x, y});
+        _create_chunk_queue->enqueue(x, y, priority);
     }
     
+    // Visibility only changes for chunks that crossed the edge of the view or the loaded area, or
+    // that were filled since, so a camera that stays inside the same chunks costs nothing here
     void update_chunks(const Rect &camera_bounds, const Rect &max_bounds) {
-        // Collect chunks to update without holding the lock
-        std::vector<Chunk*> chunks_to_update;
+        ChunkWindow window(camera_bounds, max_bounds);
+        std::vector<uint64_t> unplaced;
         {
-            std::shared_lock<std::shared_mutex> lock(_chunks_lock);
-            chunks_to_update.reserve(_chunks.size());
-            for (const auto& [id, chunk] : _chunks)
-                chunks_to_update.push_back(chunk);
+            std::lock_guard<std::mutex> lock(_unplaced_lock);
+            unplaced.swap(_unplaced);
         }
+        if (window == _placed && unplaced.empty())
+            return;
 
         // Collect deletion updates and events
         std::vector<std::pair<uint64_t, bool>> deletion_updates;
         std::vector<ChunkEvent> events;
-        deletion_updates.reserve(chunks_to_update.size());
-        events.reserve(chunks_to_update.size());
 
-        // Update chunks without holding any locks
-        for (auto chunk : chunks_to_update) {
-            if (!chunk->is_ready())
-                continue;
+        auto place = [&](Chunk *chunk) {
+            // Chunks still waiting on their neighbours have to be able to go out of range too
+            if (chunk == nullptr || !chunk->is_filled() || chunk->is_destroyed())
+                return;
 
             ChunkVisibility last_visibility = chunk->visibility();
-            Rect chunk_bounds = chunk->bounds();
-            ChunkVisibility new_visibility = !max_bounds.intersects(chunk_bounds) ? ChunkVisibility::OutOfSign :
-                                             camera_bounds.intersects(chunk_bounds) ? ChunkVisibility::Visible :
-                                             ChunkVisibility::Occluded;
+            ChunkVisibility new_visibility = window.visibility(chunk->x(), chunk->y());
             chunk->set_visibility(new_visibility);
             if (new_visibility != last_visibility) {
+                if (last_visibility == ChunkVisibility::Visible) {
+                    auto it = std::find(_draw_list.begin(), _draw_list.end(), chunk->id());
+                    if (it != _draw_list.end()) {
+                        *it = _draw_list.back();
+                        _draw_list.pop_back();
+                    }
+                } else if (new_visibility == ChunkVisibility::Visible)
+                    _draw_list.push_back(chunk->id());
+
                 std::cout << fmt::format("Chunk at ({}, {}) visibility changed from {} to {}\n",
                                          chunk->x(), chunk->y(),
                                          Chunk::visibility_to_string(last_visibility),
@@ -302,6 +633,25 @@ public:
                 // Collect events to process later
                 events.push_back({ChunkEvent::VisibilityChanged, chunk->x(), chunk->y(), last_visibility, new_visibility});
             }
+        };
+
+        {
+            // Straight off the map, readers don't hold anything writers wait on
+            ChunkMap::Pin pin;
+            for (uint64_t id : unplaced)
+                place(_chunks.find(id));
+            if (window != _placed) {
+                auto place_at = [&](int x, int y) {
+                    place(_chunks.find(index(x, y)));
+                };
+                // Chunks in both the old and new ranges keep their visibility. The few visited
+                // twice get the same answer the second time
+                window.terrain.for_each_outside(_placed.terrain, place_at);
+                _placed.terrain.for_each_outside(window.terrain, place_at);
+                window.visible.for_each_outside(_placed.visible, place_at);
+                _placed.visible.for_each_outside(window.visible, place_at);
+                _placed = window;
+            }
         }
 
         // Apply deletion queue updates in batch
@@ -326,103 +676,174 @@ public:
 
     void update_deletion_queue() {
         auto now = stm_now();
-        std::vector<uint64_t> chunks_to_destroy;
-        {
-            std::unique_lock<std::shared_mutex> lock(_deletion_queue_lock);
-            for (auto it = _deletion_queue.begin(); it != _deletion_queue.end();) {
-                if (stm_sec(stm_diff(now, it->second)) > CHUNK_DELETION_TIMEOUT) {
-                    std::cout << fmt::format("Chunk with ID {} exceeded deletion timeout, marking for destruction\n", it->first);
-                    chunks_to_destroy.push_back(it->first);
-                    it = _deletion_queue.erase(it);
-                } else
-                    ++it;
+        ChunkMap::Pin pin;
+        std::unique_lock<std::shared_mutex> lock(_deletion_queue_lock);
+        for (auto it = _deletion_queue.begin(); it != _deletion_queue.end();) {
+            if (stm_sec(stm_diff(now, it->second)) <= CHUNK_DELETION_TIMEOUT) {
+                ++it;
+                continue;
             }
-        }
-        
-        // Mark chunks for destruction outside the lock
-        for (uint64_t chunk_id : chunks_to_destroy) {
-            _chunks_being_destroyed.insert(chunk_id);
-            // Find and mark the chunk as destroyed
-            std::shared_lock<std::shared_mutex> chunks_lock(_chunks_lock);
-            auto it = _chunks.find(chunk_id);
-            if (it != _chunks.end() && it->second)
-                it->second->mark_destroyed();
+            // Only chunks with nothing in flight can go, one being loaded or meshed is tried again next frame
+            ChunkSlot *slot = _chunks.find_slot(it->first);
+            Chunk *chunk = slot ? slot->chunk.load() : nullptr;
+            if (chunk != nullptr && !slot->advance(ChunkLifecycle::Uploaded, ChunkLifecycle::Evicting) &&
+                !slot->advance(ChunkLifecycle::Filled, ChunkLifecycle::Evicting)) {
+                ++it;
+                continue;
+            }
+            std::cout << fmt::format("Chunk with ID {} exceeded deletion timeout, marking for destruction\n", it->first);
+            if (chunk != nullptr)
+                chunk->mark_destroyed();
+            it = _deletion_queue.erase(it);
         }
     }
 
-    void scan_for_chunks(const Rect &camera_bounds, const Rect &max_bounds) {
-        glm::vec2 tl = glm::vec2(max_bounds.x, max_bounds.y);
-        glm::vec2 br = glm::vec2(max_bounds.x + max_bounds.w, max_bounds.y + max_bounds.h);
-        glm::vec2 tl_chunk = _camera->world_to_chunk(tl);
-        glm::vec2 br_chunk = _camera->world_to_chunk(br);
-        for (int y = (int)tl_chunk.y; y <= (int)br_chunk.y; y++)
-            for (int x = (int)tl_chunk.x; x <= (int)br_chunk.x; x++) {
-                Rect chunk_bounds = Chunk::bounds(x, y);
-                if (chunk_bounds.intersects(max_bounds))
-                    ensure_chunk(x, y, chunk_bounds.intersects(camera_bounds));
-            }
+    void set_upload_budget(size_t bytes, double ms) {
+        _upload_budget_bytes = bytes;
+        _upload_budget_ms = ms;
     }
 
-    std::vector<ChunkEvent> release_chunks() {
-        std::vector<uint64_t> chunks_to_destroy;
-        std::vector<Chunk*> chunks_to_delete;
-        std::vector<ChunkEvent> events_to_queue;
-        {
-            std::unique_lock<std::shared_mutex> lock(_chunks_lock);
-            // Iterate through chunks and check if they're marked for destruction
-            for (auto it = _chunks.begin(); it != _chunks.end();) {
-                uint64_t chunk_id = it->first;
-                Chunk* chunk = it->second;
-                if (_chunks_being_destroyed.contains(chunk_id)) {
-                    std::cout << fmt::format("Releasing chunk at ({}, {})\n", chunk->x(), chunk->y());
-                    chunks_to_delete.push_back(chunk);
-                    chunks_to_destroy.push_back(chunk_id);
-                    events_to_queue.push_back({ChunkEvent::Deleted, chunk->x(), chunk->y()});
-                    it = _chunks.erase(it);
-                } else
-                    ++it;
+    // Main thread, upload finished meshes until the per-frame byte or time budget runs out
+    // At least one chunk goes up every frame so a single huge mesh can't stall the queue
+    void upload_chunks() {
+        uint64_t start = stm_now();
+        ChunkUploadStats stats;
+        while (true) {
+            uint64_t idx;
+            {
+                std::lock_guard<std::mutex> lock(_upload_queue_lock);
+                if (_upload_queue.empty())
+                    break;
+                if (stats.uploaded > 0 &&
+                    (stats.bytes >= _upload_budget_bytes || stm_ms(stm_since(start)) >= _upload_budget_ms))
+                    break;
+                idx = _upload_queue.front();
+                _upload_queue.pop_front();
             }
-        }
 
-        // Save chunks to disk and delete them outside of the lock
-        for (Chunk* chunk : chunks_to_delete) {
-            // Try to save chunk to disk before deletion
-            std::string chunk_filepath = _get_chunk_filepath(chunk->x(), chunk->y());
-            try {
-                if (chunk->serialize(chunk_filepath.c_str()))
-                    std::cout << fmt::format("Saved chunk at ({}, {}) to {}\n", chunk->x(), chunk->y(), chunk_filepath);
-                else
-                    std::cout << fmt::format("Failed to save chunk at ({}, {}) to {}\n", chunk->x(), chunk->y(), chunk_filepath);
-            } catch (const std::exception& e) {
-                std::cout << fmt::format("Error saving chunk at ({}, {}) to {}: {}\n", chunk->x(), chunk->y(), chunk_filepath, e.what());
+            // Meshed chunks can't be evicted, so it's still here
+            ChunkMap::Pin pin;
+            ChunkSlot *slot = _chunks.find_slot(idx);
+            Chunk *chunk = slot ? slot->chunk.load() : nullptr;
+            if (chunk == nullptr)
+                continue;
+            size_t bytes = chunk->upload_size();
+            if (chunk->upload(_quad_index_buffer())) {
+                stats.uploaded++;
+                stats.bytes += bytes;
+                std::cout << fmt::format("Chunk at ({}, {}) finished building\n", chunk->x(), chunk->y());
             }
-            delete chunk;
+            slot->advance(ChunkLifecycle::Meshed, ChunkLifecycle::Uploaded);
+            // Changed while it was being built
+            if (slot->remesh.exchange(false))
+                _remesh(*slot);
+        }
+        stats.ms = stm_ms(stm_since(start));
+        {
+            std::lock_guard<std::mutex> lock(_upload_queue_lock);
+            stats.pending = _upload_queue.size();
         }
-        // Remove from destroyed set
-        for (uint64_t chunk_id : chunks_to_destroy)
-            _chunks_being_destroyed.erase(chunk_id);
+        _upload_stats = stats;
+    }
 
-        return events_to_queue;
+    ChunkUploadStats upload_stats() const {
+        return _upload_stats;
     }
 
-    void draw_chunks(sg_pipeline pipeline, bool force_update_mvp) {
-        // Collect valid chunks without holding the lock for too long
-        std::vector<std::pair<uint64_t, Chunk*>> valid_chunks;
-        {
-            std::shared_lock<std::shared_mutex> lock(_chunks_lock);
-            valid_chunks.reserve(_chunks.size());
-            for (const auto& [id, chunk] : _chunks)
-                if (chunk != nullptr && !_chunks_being_destroyed.contains(id))
-                    valid_chunks.emplace_back(id, chunk);
+    // Only requests the chunks that came into range since the last scan, everything already in
+    // range was requested then. Nothing happens while the camera stays inside the same chunks
+    void scan_for_chunks(const Rect &camera_bounds, const Rect &max_bounds) {
+        ChunkWindow window(camera_bounds, max_bounds);
+        // A chunk that came back into range while it was being released still had its slot,
+        // so it wasn't requested again then
+        for (auto [x, y] : _evicted)
+            if (window.terrain.contains(x, y))
+                ensure_chunk(x, y, window.visible.contains(x, y));
+        _evicted.clear();
+        if (window == _scanned)
+            return;
+
+        // Re-order outstanding requests around the camera and drop the ones that fell out of range
+        _create_chunk_queue->update(camera_bounds, ChunkWindow::terrain_bounds(max_bounds));
+        window.terrain.for_each_outside(_scanned.terrain, [&](int x, int y) {
+            ensure_chunk(x, y, window.visible.contains(x, y));
+        });
+        _scanned = window;
+    }
+
+    std::vector<ChunkEvent> release_chunks() {
+        std::vector<ChunkEvent> events_to_queue;
+        // Only the main thread releases chunks, so nothing found here can go before it's looked at
+        std::vector<ChunkSlot*> chunks_to_release;
+        ChunkMap::Pin pin;
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            if (slot.state.load() == ChunkLifecycle::Evicting && slot.chunk.load() != nullptr)
+                chunks_to_release.push_back(&slot);
+        });
+        for (ChunkSlot *slot : chunks_to_release) {
+            // Evicting chunks never get a mesh built, but one in the pipeline is held until its
+            // current stage is done
+            if (!_pipeline->release(slot->key))
+                continue;
+            Chunk *chunk = slot->chunk.exchange(nullptr);
+            std::cout << fmt::format("Releasing chunk at ({}, {})\n", chunk->x(), chunk->y());
+            events_to_queue.push_back({ChunkEvent::Deleted, chunk->x(), chunk->y()});
+            // Workers may still be reading it, it goes once they've let go. Until then the slot
+            // stays so the chunk isn't requested again before the writer has it
+            _chunks.retire([this, chunk, key = slot->key, x = chunk->x(), y = chunk->y()]() {
+                // GPU resources have to go on the main thread, the writer caches, saves and frees the rest
+                chunk->release();
+                _chunk_writer->submit(chunk);
+                _chunks.erase(key);
+                _evicted.emplace_back(x, y);
+            });
         }
+        // Runs the releases retired on earlier frames, this frame's wait for the pin to go
+        _chunks.collect();
+        return events_to_queue;
+    }
 
-        for (const auto& [id, chunk] : valid_chunks) {
-            // Double-check chunk is still valid (avoid race condition)
-            if (_chunks_being_destroyed.contains(id))
+    // Only the chunks in view, everything else was culled when its visibility changed
+    // Vertex meshes and tile images need different pipelines, each is applied once
+    // Zoomed out past CHUNK_OVERVIEW_ZOOM every chunk is drawn from its overview in one
+    // tilemap pass, so the cost no longer depends on how many tiles are on screen
+    void draw_chunks(sg_pipeline pipeline, sg_pipeline tilemap_pipeline, bool force_update_mvp) {
+        ChunkDrawStats stats;
+        stats.overview = _camera && _camera->zoom() < CHUNK_OVERVIEW_ZOOM;
+        ChunkMap::Pin pin;
+        for (bool tilemap : {false, true}) {
+            if (stats.overview && !tilemap)
                 continue;
-            sg_apply_pipeline(pipeline);
-            chunk->draw(force_update_mvp);
+            bool applied = false;
+            for (uint64_t id : _draw_list) {
+                ChunkSlot *slot = _chunks.find_slot(id);
+                Chunk *chunk = slot ? slot->chunk.load() : nullptr;
+                if (chunk == nullptr || slot->state.load() == ChunkLifecycle::Evicting ||
+                    (!stats.overview && chunk->uses_tilemap() != tilemap))
+                    continue;
+                if (!applied) {
+                    sg_apply_pipeline(tilemap ? tilemap_pipeline : pipeline);
+                    applied = true;
+                }
+                if (size_t vertices = chunk->draw(force_update_mvp, stats.overview)) {
+                    stats.draws++;
+                    stats.vertices += vertices;
+                }
+            }
         }
+        _draw_stats = stats;
+    }
+
+    // Main thread only. Culled is counted here rather than every frame, against the chunks that
+    // are actually resident: slots still being loaded or evicted have nothing to cull
+    ChunkDrawStats draw_stats() const {
+        ChunkDrawStats stats = _draw_stats;
+        size_t resident = 0;
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            resident += slot.chunk.load() != nullptr && slot.state.load() != ChunkLifecycle::Evicting;
+        });
+        stats.culled = resident > _draw_list.size() ? resident - _draw_list.size() : 0;
+        return stats;
     }
     
     void fire_chunk_events() {
@@ -478,27 +899,133 @@ public:
         }
     }
 
+    // Tiles the generator marked for spawning entities on, nullopt if the chunk isn't loaded
+    std::optional<std::vector<std::pair<int, int>>> spawn_points_in_chunk(int cx, int cy) {
+        ChunkMap::Pin pin;
+        Chunk *chunk = _chunks.find(index(cx, cy));
+        if (chunk && chunk->is_filled() && chunk->stage() >= ChunkStage::Seeded)
+            return chunk->spawn_points();
+        return std::nullopt;
+    }
+
     std::optional<std::pair<int, int>> random_walkable_tile_in_chunk(int cx, int cy) {
-        Chunk* chunk = nullptr;
-        uint64_t idx = index(cx, cy);
-        {
-            std::shared_lock<std::shared_mutex> lock(_chunks_lock);
-            auto it = _chunks.find(idx);
-            if (it != _chunks.end())
-                chunk = it->second;
-        }
+        ChunkMap::Pin pin;
+        Chunk *chunk = _chunks.find(index(cx, cy));
         if (chunk && chunk->is_filled())
             return chunk->random_walkable_tile();
         return std::nullopt;
     }
 
-    bool is_chunk_loaded(int cx, int cy) {
-        uint64_t idx = index(cx, cy);
-        std::shared_lock<std::shared_mutex> lock(_chunks_lock);
-        auto it = _chunks.find(idx);
-        if (it == _chunks.end())
+    ChunkRequestStats request_stats() const {
+        return _create_chunk_queue ? _create_chunk_queue->stats() : ChunkRequestStats();
+    }
+
+    // Resident chunks are meshed again with the new table
+    void set_autotile(AutotileTable table) {
+        {
+            std::lock_guard<std::mutex> lock(_autotile_lock);
+            _autotile = std::make_shared<const AutotileTable>(std::move(table));
+        }
+        ChunkMap::Pin pin;
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            _remesh(slot);
+        });
+    }
+
+    std::shared_ptr<const AutotileTable> autotile() const {
+        std::lock_guard<std::mutex> lock(_autotile_lock);
+        return _autotile;
+    }
+
+    // Chunks already on screen keep what they were drawn with until they're meshed again
+    void set_tilemap_rendering(bool enabled) {
+        if (_tilemap_rendering.exchange(enabled) == enabled)
+            return;
+        ChunkMap::Pin pin;
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            _remesh(slot);
+        });
+    }
+
+    bool tilemap_rendering() const {
+        return _tilemap_rendering.load();
+    }
+
+    // Switch between decoding from a mapped region file and the stream path
+    void set_mapped_loading(bool enabled) {
+        _mapped_loading.store(enabled);
+    }
+
+    // How many chunks are in each state
+    std::array<size_t, static_cast<size_t>(ChunkLifecycle::Evicting) + 1> lifecycle_stats() const {
+        std::array<size_t, static_cast<size_t>(ChunkLifecycle::Evicting) + 1> counts{};
+        _chunks.for_each_slot([&](ChunkSlot &slot) {
+            counts[static_cast<size_t>(slot.state.load())]++;
+        });
+        return counts;
+    }
+
+    ChunkPipelineStats pipeline_stats() const {
+        return _pipeline ? _pipeline->stats() : ChunkPipelineStats();
+    }
+
+    GenerationScriptStats script_stats() const {
+        return _scripts.stats();
+    }
+
+    ChunkLoadStats load_stats() const {
+        std::lock_guard<std::mutex> lock(_load_stats_lock);
+        return _load_stats;
+    }
+
+    ChunkWriterStats writer_stats() const {
+        return _chunk_writer ? _chunk_writer->stats() : ChunkWriterStats();
+    }
+
+    ChunkMemoryStats memory_stats(size_t *chunk_count = nullptr) const {
+        ChunkMemoryStats stats;
+        size_t count = 0;
+        _chunks.for_each([&](uint64_t, Chunk *chunk) {
+            stats += chunk->memory_stats();
+            count++;
+        });
+        if (chunk_count)
+            *chunk_count = count;
+        return stats;
+    }
+
+    // World tile coordinates, returns false if the chunk isn't loaded or nothing changed
+    // A changed chunk is re-meshed and picked up by the next upload_chunks()
+    bool set_tile(int tx, int ty, bool solid) {
+        int cx, cy, lx, ly;
+        _tile_to_chunk(tx, ty, cx, cy, lx, ly);
+        ChunkMap::Pin pin;
+        ChunkSlot *slot = _chunks.find_slot(index(cx, cy));
+        Chunk *chunk = slot ? slot->chunk.load() : nullptr;
+        if (chunk == nullptr || chunk->is_destroyed() ||
+            !chunk->set_solid(lx, ly, solid))
             return false;
-        return it->second != nullptr && it->second->is_filled();
+        _remesh(*slot);
+        // Neighbours see this tile through their halo
+        if (lx == 0 || ly == 0 || lx == CHUNK_WIDTH - 1 || ly == CHUNK_HEIGHT - 1)
+            _link_neighbours(chunk);
+        return true;
+    }
+
+    std::optional<Tile> get_tile(int tx, int ty) {
+        int cx, cy, lx, ly;
+        _tile_to_chunk(tx, ty, cx, cy, lx, ly);
+        ChunkMap::Pin pin;
+        Chunk *chunk = _chunks.find(index(cx, cy));
+        if (chunk == nullptr)
+            return std::nullopt;
+        return chunk->tile(lx, ly);
+    }
+
+    bool is_chunk_loaded(int cx, int cy) {
+        ChunkMap::Pin pin;
+        Chunk *chunk = _chunks.find(index(cx, cy));
+        return chunk != nullptr && chunk->is_filled();
     }
     
     void clear() {
@@ -507,12 +1034,14 @@ public:
         // Set shutdown flag first to prevent job processors from acquiring locks
         _shutting_down.store(true);
         
-        // Stop JobQueues - worker threads will check _shutting_down and skip lock acquisition
-        // This prevents deadlock where worker threads wait for _chunks_lock while
-        // main thread waits for worker threads to join
+        // Stop JobQueues - worker threads will check _shutting_down and skip the rest of their job,
+        // once they've returned nothing else inserts into the map
         if (_create_chunk_queue) {
             _create_chunk_queue->stop();
         }
+        if (_pipeline) {
+            _pipeline->stop();
+        }
         if (_build_chunk_queue) {
             _build_chunk_queue->stop();
         }
@@ -522,21 +1051,133 @@ public:
             _deletion_queue.clear();
         }
         {
-            std::unique_lock<std::shared_mutex> lock(_chunks_lock);
-            // Save all remaining chunks before deletion
-            for (auto& [id, chunk] : _chunks) {
-                if (chunk == nullptr)
-                    continue;
-                std::string chunk_filepath = _get_chunk_filepath(chunk->x(), chunk->y());
-                try {
-                    chunk->serialize(chunk_filepath.c_str());
-                    std::cout << fmt::format("Saved chunk at ({}, {}) to {} on shutdown\n", chunk->x(), chunk->y(), chunk_filepath);
-                } catch (const std::exception& e) {
-                    std::cout << fmt::format("Error saving chunk at ({}, {}) to {} on shutdown: {}\n", chunk->x(), chunk->y(), chunk_filepath, e.what());
-                }
+            std::lock_guard<std::mutex> lock(_unplaced_lock);
+            _unplaced.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(_upload_queue_lock);
+            _upload_queue.clear();
+        }
+        // Chunks released on earlier frames go to the writer first, they're older than what's loaded.
+        // Path jobs can still be reading, they're short, so wait for them
+        while (_chunks.collect())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // Hand everything left to the writer, stopping it below writes it all out
+        _evicted.clear();
+        _draw_list.clear();
+        if (_quad_indices.id != SG_INVALID_ID && sg_isvalid())
+            sg_destroy_buffer(_quad_indices);
+        _quad_indices = {SG_INVALID_ID};
+        _scanned = ChunkWindow();
+        _placed = ChunkWindow();
+        for (auto& [id, chunk] : _chunks.clear()) {
+            chunk->release();
+            if (chunk->needs_save())
+                _chunk_writer->submit(chunk);
+            else
                 delete chunk;
-            }
-            _chunks.clear();
         }
+        if (_chunk_writer)
+            _chunk_writer->stop();
+        if (_saver)
+            _saver->finish();
+        if (_regions)
+            _regions->close_all();
+        _cache.clear();
+    }
+
+    ChunkCacheStats cache_stats() const {
+        return _cache.stats();
+    }
+
+    void set_cache_budget(size_t bytes) {
+        _cache.set_budget(bytes);
+    }
+
+    RegionStoreStats save_stats() const {
+        return _regions ? _regions->stats() : RegionStoreStats();
+    }
+
+    // Where the region files for this session live
+    std::string save_directory() const {
+        return _regions ? _regions->directory().string() : std::string();
+    }
+
+    // Coordinates of every chunk that's been saved to a region file
+    std::vector<std::pair<int, int>> saved_chunks() {
+        return _regions ? _regions->chunks() : std::vector<std::pair<int, int>>();
+    }
+
+    // Index an imported .niceworld, chunks are read out of it on demand
+    bool attach_archive(const std::string &path) {
+        return _archive.open(path);
+    }
+
+    size_t archived_chunks() const {
+        return _archive.size();
+    }
+
+    // The seed from the imported archive's manifest, false if it has none
+    bool archived_seed(uint64_t &seed) const {
+        return _archive.seed(seed);
+    }
+
+    // Every chunk that isn't saved is generated from this and its coordinates
+    void set_seed(uint64_t seed) {
+        _seed.store(seed);
+    }
+
+    // Script run on every chunk as it's generated, see GenerationScripts
+    void load_generation_script(const std::string &source, const std::string &name) {
+        _scripts.load(source, name);
+    }
+
+    // Archive that saved chunks are appended to as they're written, a new one is created with
+    // the seed in its manifest
+    void save_to(const std::string &path, uint64_t seed) {
+        delete _saver;
+        _saver = new WorldSaver(path, seed);
+    }
+
+    // Save every modified chunk that's still loaded without waiting for it to be evicted
+    // Only the encoding happens on this thread, returns how many chunks were queued
+    size_t checkpoint() {
+        if (!_chunk_writer || !_regions)
+            return 0;
+        std::vector<RegionStore::Write> writes;
+        _chunks.for_each([&](uint64_t, Chunk *chunk) {
+            if (!chunk->needs_save())
+                return;
+            // Marked saved once it's written, see RegionStore::save(). The chunk can't be freed
+            // before then, evictions submitted after this are written after it
+            uint64_t revision = chunk->revision();
+            writes.push_back({chunk->x(), chunk->y(), chunk->encode(), chunk, revision});
+        });
+        size_t count = writes.size();
+        if (count == 0)
+            return 0;
+        // Goes through the writer so it can't land after a newer copy of the same chunk
+        _chunk_writer->post([this, writes = std::move(writes)]() mutable {
+            try {
+                _save_writes(writes);
+                std::cout << fmt::format("Checkpoint saved {} chunks\n", writes.size());
+            } catch (const std::exception& e) {
+                std::cout << fmt::format("Error saving checkpoint of {} chunks: {}\n", writes.size(), e.what());
+            }
+        });
+        return count;
+    }
+
+    WorldSaverStats archive_stats() const {
+        return _saver ? _saver->stats() : WorldSaverStats();
+    }
+
+    // Close the archives and any open region files, only once chunks are cleared
+    void close_storage() {
+        delete _saver;
+        _saver = nullptr;
+        _archive.close();
+        if (_regions)
+            _regions->close_all();
     }
 };
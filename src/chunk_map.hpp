@@ -0,0 +1,387 @@
+//
+//  chunk_map.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "chunk.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <limits>
+#include <utility>
+
+// Where a chunk is in its life, a slot only moves between these with compare and swap
+enum class ChunkLifecycle : uint8_t {
+    Requested, // Queued to be loaded or generated
+    Loading,   // A worker is loading or creating it
+    Filled,    // Has tiles, still going through the generation pipeline
+    Meshed,    // Mesh being built, or waiting for upload_chunks()
+    Uploaded,  // On the GPU with nothing in flight
+    Evicting   // Waiting to be released and handed to the writer
+};
+
+// A chunk index's entry in the ChunkMap, from the moment it's requested until it's released
+struct ChunkSlot {
+    const uint64_t key;
+    std::atomic<Chunk*> chunk;           // Set once it's loaded, cleared when it's released
+    std::atomic<ChunkLifecycle> state;
+    std::atomic<bool> remesh{false};     // Changed while Meshed, build it again once it's uploaded
+
+    ChunkSlot(uint64_t key, ChunkLifecycle state, Chunk *chunk = nullptr)
+        : key(key)
+        , chunk(chunk)
+        , state(state) {}
+
+    // Fails if something else moved it first
+    bool advance(ChunkLifecycle from, ChunkLifecycle to) {
+        return state.compare_exchange_strong(from, to);
+    }
+
+    static const char* state_to_string(ChunkLifecycle state) {
+        switch (state) {
+            case ChunkLifecycle::Requested:
+                return "requested";
+            case ChunkLifecycle::Loading:
+                return "loading";
+            case ChunkLifecycle::Filled:
+                return "filled";
+            case ChunkLifecycle::Meshed:
+                return "meshed";
+            case ChunkLifecycle::Uploaded:
+                return "uploaded";
+            case ChunkLifecycle::Evicting:
+                return "evicting";
+            default:
+                return "unknown";
+        }
+    }
+};
+
+// Chunk index -> slot, readers never take a lock
+// Open addressing with linear probing over an array of atomic pointers to slots. Writers are
+// serialised by a mutex, they're rare next to the lookups (paths, tiles, the per-frame scan,
+// update and draw). Anything a writer unlinks, slots, old tables and the chunks themselves, is
+// retired and only freed once every reader that might still see it is gone: readers pin the
+// global epoch while they hold pointers out of the map (see Pin), and retired work runs once
+// every pinned reader has moved past the epoch it was retired in.
+class ChunkMap {
+    struct Table {
+        size_t mask;
+        std::unique_ptr<std::atomic<ChunkSlot*>[]> slots;
+
+        explicit Table(size_t capacity)
+            : mask(capacity - 1)
+            , slots(new std::atomic<ChunkSlot*>[capacity]) {
+            for (size_t i = 0; i < capacity; i++)
+                slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        size_t capacity() const {
+            return mask + 1;
+        }
+    };
+
+    // One per thread that has ever read from a map, reused once the thread exits
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0}; // 0 while the thread isn't reading
+        std::atomic<bool> claimed{false};
+        ReaderSlot *next = nullptr;
+    };
+
+    struct ThreadReader {
+        ReaderSlot *slot = nullptr;
+        int depth = 0;
+
+        ~ThreadReader() {
+            if (slot)
+                slot->claimed.store(false, std::memory_order_release);
+        }
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> free;
+    };
+
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    inline static std::atomic<uint64_t> _epoch{1};
+    inline static std::atomic<ReaderSlot*> _readers{nullptr}; // Never freed, threads come and go
+    static thread_local ThreadReader _reader;
+    inline static ChunkSlot _tombstone{0, ChunkLifecycle::Evicting};
+
+    std::atomic<Table*> _table;
+    std::atomic<size_t> _size{0};
+    size_t _used = 0; // Live slots and tombstones, only touched by writers
+    std::vector<Retired> _retired;
+    std::mutex _write_lock;
+
+    static uint64_t _hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ULL;
+        return key ^ (key >> 33);
+    }
+
+    static ReaderSlot* _claim_slot() {
+        for (ReaderSlot *slot = _readers.load(std::memory_order_acquire); slot; slot = slot->next) {
+            bool expected = false;
+            if (!slot->claimed.load(std::memory_order_relaxed) &&
+                slot->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                return slot;
+        }
+        ReaderSlot *slot = new ReaderSlot();
+        slot->claimed.store(true, std::memory_order_relaxed);
+        slot->next = _readers.load(std::memory_order_relaxed);
+        while (!_readers.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed));
+        return slot;
+    }
+
+    // Oldest epoch a reader is still pinned at, max if nobody is reading
+    static uint64_t _oldest_reader() {
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for (ReaderSlot *slot = _readers.load(std::memory_order_acquire); slot; slot = slot->next) {
+            uint64_t epoch = slot->epoch.load();
+            if (epoch != 0 && epoch < oldest)
+                oldest = epoch;
+        }
+        return oldest;
+    }
+
+    // Table entry holding key, or the first free one for it. _write_lock must be held
+    std::atomic<ChunkSlot*>* _probe(Table *table, uint64_t key, bool &found) const {
+        std::atomic<ChunkSlot*> *free = nullptr;
+        for (size_t i = _hash(key) & table->mask, n = 0; n <= table->mask; i = (i + 1) & table->mask, n++) {
+            ChunkSlot *entry = table->slots[i].load(std::memory_order_relaxed);
+            if (entry == nullptr) {
+                found = false;
+                return free ? free : &table->slots[i];
+            }
+            if (entry == &_tombstone) {
+                if (!free)
+                    free = &table->slots[i];
+            } else if (entry->key == key) {
+                found = true;
+                return &table->slots[i];
+            }
+        }
+        found = false;
+        return free;
+    }
+
+    // Copy the live slots into a table sized for them, the old one is retired. _write_lock must be held
+    void _rehash(size_t live) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < live * 2)
+            capacity *= 2;
+        Table *old = _table.load(std::memory_order_relaxed);
+        Table *table = new Table(capacity);
+        for (size_t i = 0; i <= old->mask; i++) {
+            ChunkSlot *entry = old->slots[i].load(std::memory_order_relaxed);
+            if (entry == nullptr || entry == &_tombstone)
+                continue;
+            for (size_t j = _hash(entry->key) & table->mask;; j = (j + 1) & table->mask)
+                if (table->slots[j].load(std::memory_order_relaxed) == nullptr) {
+                    table->slots[j].store(entry, std::memory_order_relaxed);
+                    break;
+                }
+        }
+        _used = live;
+        _table.store(table);
+        _retire_locked([old]() { delete old; });
+    }
+
+    void _retire_locked(std::function<void()> free) {
+        _retired.push_back({_epoch.fetch_add(1), std::move(free)});
+    }
+
+public:
+    // Keeps everything read out of the map alive until it goes out of scope, pins nest
+    // Hold one for as long as a Chunk* from the map is in use, and don't block on writers while pinned
+    class Pin {
+    public:
+        Pin() {
+            ThreadReader &reader = _reader;
+            if (reader.depth++ > 0)
+                return;
+            if (!reader.slot)
+                reader.slot = _claim_slot();
+            reader.slot->epoch.store(_epoch.load());
+            // Loads from the table can't move above this, or a writer could miss us
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        ~Pin() {
+            ThreadReader &reader = _reader;
+            if (--reader.depth == 0)
+                reader.slot->epoch.store(0, std::memory_order_release);
+        }
+
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+    };
+
+    ChunkMap()
+        : _table(new Table(MIN_CAPACITY)) {}
+
+    ChunkMap(const ChunkMap&) = delete;
+    ChunkMap& operator=(const ChunkMap&) = delete;
+
+    // Nobody can be reading by now, retired work is run rather than dropped
+    ~ChunkMap() {
+        Table *table = _table.load();
+        for (size_t i = 0; i <= table->mask; i++) {
+            ChunkSlot *entry = table->slots[i].load(std::memory_order_relaxed);
+            if (entry != nullptr && entry != &_tombstone)
+                delete entry;
+        }
+        delete table;
+        for (Retired &retired : _retired)
+            retired.free();
+    }
+
+    // Needs a Pin held by the caller for as long as the result is used
+    ChunkSlot* find_slot(uint64_t key) const {
+        Table *table = _table.load(std::memory_order_acquire);
+        for (size_t i = _hash(key) & table->mask, n = 0; n <= table->mask; i = (i + 1) & table->mask, n++) {
+            ChunkSlot *entry = table->slots[i].load(std::memory_order_acquire);
+            if (entry == nullptr)
+                return nullptr;
+            if (entry != &_tombstone && entry->key == key)
+                return entry;
+        }
+        return nullptr;
+    }
+
+    // nullptr until the chunk's loaded and again once it's released
+    // Needs a Pin held by the caller for as long as the result is used
+    Chunk* find(uint64_t key) const {
+        ChunkSlot *slot = find_slot(key);
+        return slot ? slot->chunk.load(std::memory_order_acquire) : nullptr;
+    }
+
+    // Whether the index has a slot at all, whatever state it's in
+    bool contains(uint64_t key) const {
+        Pin pin;
+        return find_slot(key) != nullptr;
+    }
+
+    // Visit every slot without stopping writers, ones added or removed meanwhile may be missed
+    // Needs a Pin held by the caller if the slots are used after f returns
+    template<typename F>
+    void for_each_slot(F &&f) const {
+        Pin pin;
+        Table *table = _table.load(std::memory_order_acquire);
+        for (size_t i = 0; i <= table->mask; i++) {
+            ChunkSlot *entry = table->slots[i].load(std::memory_order_acquire);
+            if (entry != nullptr && entry != &_tombstone)
+                f(*entry);
+        }
+    }
+
+    // Same, for the slots that have a chunk
+    template<typename F>
+    void for_each(F &&f) const {
+        for_each_slot([&](ChunkSlot &slot) {
+            if (Chunk *chunk = slot.chunk.load(std::memory_order_acquire))
+                f(slot.key, chunk);
+        });
+    }
+
+    // Slots, including the ones still loading or being released
+    size_t size() const {
+        return _size.load(std::memory_order_relaxed);
+    }
+
+    // The slot for key, and whether this call created it
+    std::pair<ChunkSlot*, bool> emplace(uint64_t key, ChunkLifecycle state, Chunk *chunk = nullptr) {
+        std::lock_guard<std::mutex> lock(_write_lock);
+        Table *table = _table.load(std::memory_order_relaxed);
+        if ((_used + 1) * 4 > table->capacity() * 3) {
+            _rehash(_size.load(std::memory_order_relaxed) + 1);
+            table = _table.load(std::memory_order_relaxed);
+        }
+        bool found;
+        std::atomic<ChunkSlot*> *entry = _probe(table, key, found);
+        ChunkSlot *old = entry->load(std::memory_order_relaxed);
+        if (found)
+            return {old, false};
+        ChunkSlot *slot = new ChunkSlot(key, state, chunk);
+        entry->store(slot);
+        if (old == nullptr)
+            _used++;
+        _size.fetch_add(1, std::memory_order_relaxed);
+        return {slot, true};
+    }
+
+    // Unlink a slot and return its chunk, both stay valid for pinned readers until they've let go
+    Chunk* erase(uint64_t key) {
+        std::lock_guard<std::mutex> lock(_write_lock);
+        bool found;
+        std::atomic<ChunkSlot*> *entry = _probe(_table.load(std::memory_order_relaxed), key, found);
+        if (!found)
+            return nullptr;
+        ChunkSlot *slot = entry->load(std::memory_order_relaxed);
+        entry->store(&_tombstone);
+        Chunk *chunk = slot->chunk.load(std::memory_order_relaxed);
+        _retire_locked([slot]() { delete slot; });
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        // Mostly tombstones, probes get long so start over
+        if (_used > MIN_CAPACITY && _size.load(std::memory_order_relaxed) * 4 < _used)
+            _rehash(_size.load(std::memory_order_relaxed));
+        return chunk;
+    }
+
+    // Empty the map and return the chunks that were in it, the caller makes sure nothing is reading
+    std::vector<std::pair<uint64_t, Chunk*>> clear() {
+        std::vector<std::pair<uint64_t, Chunk*>> chunks;
+        std::lock_guard<std::mutex> lock(_write_lock);
+        Table *table = _table.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= table->mask; i++) {
+            ChunkSlot *slot = table->slots[i].load(std::memory_order_relaxed);
+            if (slot == nullptr || slot == &_tombstone)
+                continue;
+            if (Chunk *chunk = slot->chunk.load(std::memory_order_relaxed))
+                chunks.emplace_back(slot->key, chunk);
+            table->slots[i].store(&_tombstone);
+            _retire_locked([slot]() { delete slot; });
+        }
+        _size.store(0, std::memory_order_relaxed);
+        _rehash(0);
+        return chunks;
+    }
+
+    // Run free once no reader can still see what was unlinked before this call
+    void retire(std::function<void()> free) {
+        std::lock_guard<std::mutex> lock(_write_lock);
+        _retire_locked(std::move(free));
+    }
+
+    // Run whatever retired work is safe now, on the calling thread. Returns how much is still waiting
+    size_t collect() {
+        std::vector<std::function<void()>> ready;
+        size_t waiting;
+        {
+            std::lock_guard<std::mutex> lock(_write_lock);
+            uint64_t oldest = _oldest_reader();
+            auto it = _retired.begin();
+            for (; it != _retired.end() && it->epoch < oldest; ++it)
+                ready.push_back(std::move(it->free));
+            _retired.erase(_retired.begin(), it);
+            waiting = _retired.size();
+        }
+        // Outside the lock, so freeing can use the map
+        for (auto &free : ready)
+            free();
+        return waiting;
+    }
+};
+
+inline thread_local ChunkMap::ThreadReader ChunkMap::_reader;
@@ -0,0 +1,212 @@
+//
+//  chunk_pipeline.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "chunk.hpp"
+#include "job_queue.hpp"
+#include "sokol/sokol_time.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+struct ChunkStageStats {
+    size_t queued = 0;    // Chunks waiting for a worker to run this stage
+    uint64_t runs = 0;    // Times the stage has run
+    double ms = 0.0;      // Total time spent in the stage
+};
+
+struct ChunkPipelineStats {
+    std::vector<std::pair<ChunkStage, ChunkStageStats>> stages;
+    size_t waiting = 0;   // Chunks held back until their neighbours catch up
+};
+
+// Moves chunks through the generation stages, each stage has its own queue on the thread pool
+// A stage can require every neighbour to have reached an earlier stage first. Chunks that
+// can't run their next stage yet wait here and are re-checked whenever a neighbour finishes
+// one. Chunks on the edge of the requested area wait until the area grows, as their neighbours
+// are never requested. Neighbours can't be released from the time such a stage is queued until
+// it's done, so it always sees all 8. Once the last stage is done the chunk is handed to the
+// finish callback.
+class ChunkPipeline {
+public:
+    struct Stage {
+        ChunkStage stage;                 // Stage a chunk has reached once run() returns
+        ChunkStage neighbours;            // Stage all 8 neighbours need first, Empty for none
+        std::function<void(Chunk*)> run;
+    };
+
+private:
+    struct Lane {
+        Stage stage;
+        std::unique_ptr<JobQueue<Chunk*>> queue;
+        std::atomic<uint64_t> runs{0};
+        std::atomic<uint64_t> us{0};
+    };
+
+    std::vector<std::unique_ptr<Lane>> _lanes;
+    std::function<void(Chunk*)> _finish;
+    std::unordered_map<uint64_t, ChunkStage> _stages; // Every chunk the pipeline knows about
+    std::unordered_map<uint64_t, Chunk*> _waiting;
+    std::unordered_set<uint64_t> _running;
+    std::unordered_map<uint64_t, int> _pinned; // Neighbours of queued or running stages that need them
+    mutable std::mutex _mutex;
+
+    bool neighbours_at(int x, int y, ChunkStage stage) const {
+        if (stage == ChunkStage::Empty)
+            return true;
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++) {
+                if (!dx && !dy)
+                    continue;
+                auto it = _stages.find(index(x + dx, y + dy));
+                if (it == _stages.end() || it->second < stage)
+                    return false;
+            }
+        return true;
+    }
+
+    // _mutex must be held
+    void pin_neighbours(int x, int y, int delta) {
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++) {
+                if (!dx && !dy)
+                    continue;
+                auto it = _pinned.emplace(index(x + dx, y + dy), 0).first;
+                if ((it->second += delta) <= 0)
+                    _pinned.erase(it);
+            }
+    }
+
+    // Queue the chunk's next stage, or park it until its neighbours are ready. _mutex must be held
+    void advance(Chunk *chunk) {
+        uint64_t idx = chunk->id();
+        ChunkStage stage = _stages[idx];
+        for (auto& lane : _lanes) {
+            if (lane->stage.stage <= stage)
+                continue;
+            if (!neighbours_at(chunk->x(), chunk->y(), lane->stage.neighbours)) {
+                _waiting[idx] = chunk;
+                return;
+            }
+            _running.insert(idx);
+            if (lane->stage.neighbours != ChunkStage::Empty)
+                pin_neighbours(chunk->x(), chunk->y(), 1);
+            lane->queue->enqueue(chunk);
+            return;
+        }
+        _finish(chunk);
+    }
+
+    // Wake up any neighbour that was waiting on this chunk. _mutex must be held
+    void wake_neighbours(int x, int y) {
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++) {
+                if (!dx && !dy)
+                    continue;
+                auto it = _waiting.find(index(x + dx, y + dy));
+                if (it == _waiting.end())
+                    continue;
+                Chunk *neighbour = it->second;
+                _waiting.erase(it);
+                advance(neighbour);
+            }
+    }
+
+public:
+    // finish is called with the pipeline locked, it must not call back into the pipeline
+    ChunkPipeline(std::vector<Stage> stages, std::function<void(Chunk*)> finish)
+        : _finish(std::move(finish)) {
+        for (Stage &stage : stages) {
+            auto lane = std::make_unique<Lane>();
+            lane->stage = std::move(stage);
+            Lane *self = lane.get();
+            lane->queue = std::make_unique<JobQueue<Chunk*>>([this, self](Chunk *chunk) {
+                uint64_t start = stm_now();
+                self->stage.run(chunk);
+                self->us += static_cast<uint64_t>(stm_us(stm_since(start)));
+                self->runs++;
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                uint64_t idx = chunk->id();
+                _running.erase(idx);
+                if (self->stage.neighbours != ChunkStage::Empty)
+                    pin_neighbours(chunk->x(), chunk->y(), -1);
+                auto it = _stages.find(idx);
+                if (it == _stages.end())
+                    return; // Released while running, can't happen while the manager respects release()
+                it->second = self->stage.stage;
+                wake_neighbours(chunk->x(), chunk->y());
+                advance(chunk);
+            });
+            _lanes.push_back(std::move(lane));
+        }
+    }
+
+    ChunkPipeline(const ChunkPipeline&) = delete;
+    ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+    ~ChunkPipeline() {
+        stop();
+    }
+
+    // Start a chunk from whatever stage it's already at, a loaded chunk goes straight to finish
+    void submit(Chunk *chunk) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t idx = chunk->id();
+        _stages[idx] = chunk->stage();
+        _waiting.erase(idx);
+        wake_neighbours(chunk->x(), chunk->y());
+        advance(chunk);
+    }
+
+    // Forget a chunk that's being evicted, fails if a stage is running on it or a neighbour's
+    // stage needs it
+    bool release(uint64_t idx) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_running.count(idx) || _pinned.count(idx))
+            return false;
+        _stages.erase(idx);
+        _waiting.erase(idx);
+        return true;
+    }
+
+    // Stop every stage queue, queued stages are skipped
+    void stop() {
+        for (auto& lane : _lanes)
+            lane->queue->stop();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stages.clear();
+        _waiting.clear();
+        _running.clear();
+        _pinned.clear();
+    }
+
+    // No stage queued or running, waiting chunks don't count
+    bool idle() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _running.empty();
+    }
+
+    ChunkPipelineStats stats() const {
+        ChunkPipelineStats stats;
+        for (const auto& lane : _lanes) {
+            ChunkStageStats stage;
+            stage.queued = lane->queue->size();
+            stage.runs = lane->runs.load();
+            stage.ms = lane->us.load() / 1000.0;
+            stats.stages.emplace_back(lane->stage.stage, stage);
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        stats.waiting = _waiting.size();
+        return stats;
+    }
+};
@@ -0,0 +1,187 @@
+//
+//  chunk_request_queue.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "chunk.hpp"
+#include "camera.hpp"
+#include "job_queue.hpp"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+struct ChunkRequestStats {
+    uint64_t requested = 0; // Requests accepted into the queue
+    uint64_t completed = 0; // Finished while still in range
+    uint64_t cancelled = 0; // Dropped before a worker picked them up
+    uint64_t wasted = 0;    // Finished after the camera had already moved away
+    size_t pending = 0;     // Waiting for a worker right now
+};
+
+// Chunk creation requests ordered by distance to the camera
+// Workers don't take a specific request, they take whatever is nearest when they
+// get to it, so the order follows the camera as it moves. Requests that leave
+// max_bounds before they're picked up are dropped instead of being generated.
+class ChunkRequestQueue {
+    struct Request {
+        int x, y;
+        float distance;
+    };
+
+    std::vector<Request> _requests;
+    bool _sorted = true;
+    glm::vec2 _focus = glm::vec2(0.f);
+    Rect _max_bounds;
+    bool _has_bounds = false;
+    mutable std::mutex _mutex;
+
+    std::function<void(int, int)> _processor;
+    std::function<void(int, int)> _on_cancel;
+    JobQueue<bool> _workers;
+
+    std::atomic<uint64_t> _requested{0};
+    std::atomic<uint64_t> _completed{0};
+    std::atomic<uint64_t> _cancelled{0};
+    std::atomic<uint64_t> _wasted{0};
+
+    float distance_to_focus(int x, int y) const {
+        Rect b = Chunk::bounds(x, y);
+        glm::vec2 center = glm::vec2(b.x + b.w * .5f, b.y + b.h * .5f);
+        glm::vec2 delta = center - _focus;
+        return delta.x * delta.x + delta.y * delta.y;
+    }
+
+    bool in_range(int x, int y) const {
+        return !_has_bounds || Chunk::bounds(x, y).intersects(_max_bounds);
+    }
+
+    void cancel(const std::vector<Request> &cancelled) {
+        _cancelled += cancelled.size();
+        if (_on_cancel)
+            for (const auto& request : cancelled)
+                _on_cancel(request.x, request.y);
+    }
+
+    bool pop(Request &out) {
+        std::vector<Request> cancelled;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_sorted) {
+                // Furthest first, so the nearest request is always at the back
+                std::sort(_requests.begin(), _requests.end(), [](const Request &a, const Request &b) {
+                    return a.distance > b.distance;
+                });
+                _sorted = true;
+            }
+            while (!_requests.empty()) {
+                Request request = _requests.back();
+                _requests.pop_back();
+                if (!in_range(request.x, request.y)) {
+                    cancelled.push_back(request);
+                    continue;
+                }
+                out = request;
+                found = true;
+                break;
+            }
+        }
+        cancel(cancelled);
+        return found;
+    }
+
+    void process() {
+        Request request;
+        if (!pop(request))
+            return;
+        _processor(request.x, request.y);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (in_range(request.x, request.y))
+            _completed++;
+        else
+            _wasted++;
+    }
+
+public:
+    ChunkRequestQueue(std::function<void(int, int)> processor, std::function<void(int, int)> on_cancel = nullptr)
+        : _processor(std::move(processor))
+        , _on_cancel(std::move(on_cancel))
+        , _workers([this](bool) { this->process(); }) {}
+
+    ChunkRequestQueue(const ChunkRequestQueue&) = delete;
+    ChunkRequestQueue& operator=(const ChunkRequestQueue&) = delete;
+
+    ~ChunkRequestQueue() {
+        stop();
+    }
+
+    // The caller is responsible for not requesting the same chunk twice
+    void enqueue(int x, int y, bool priority = false) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _requests.push_back({x, y, distance_to_focus(x, y)});
+            _sorted = false;
+        }
+        _requested++;
+        // One pool job per request, each one takes the nearest request when it runs
+        if (priority)
+            _workers.enqueue_priority(true);
+        else
+            _workers.enqueue(true);
+    }
+
+    // Re-score against the current camera and drop anything that's left max_bounds
+    void update(const Rect &camera_bounds, const Rect &max_bounds) {
+        std::vector<Request> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _focus = glm::vec2(camera_bounds.x + camera_bounds.w * .5f,
+                               camera_bounds.y + camera_bounds.h * .5f);
+            _max_bounds = max_bounds;
+            _has_bounds = true;
+            auto it = std::remove_if(_requests.begin(), _requests.end(), [&](Request &request) {
+                if (!in_range(request.x, request.y)) {
+                    cancelled.push_back(request);
+                    return true;
+                }
+                request.distance = distance_to_focus(request.x, request.y);
+                return false;
+            });
+            _requests.erase(it, _requests.end());
+            _sorted = false;
+        }
+        cancel(cancelled);
+    }
+
+    void stop() {
+        _workers.stop();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.clear();
+    }
+
+    bool empty() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _requests.empty() && _workers.running_jobs() == 0;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _requests.size();
+    }
+
+    ChunkRequestStats stats() const {
+        ChunkRequestStats stats;
+        stats.requested = _requested.load();
+        stats.completed = _completed.load();
+        stats.cancelled = _cancelled.load();
+        stats.wasted = _wasted.load();
+        stats.pending = size();
+        return stats;
+    }
+};
@@ -0,0 +1,230 @@
+//
+//  chunk_writer.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "chunk.hpp"
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+struct ChunkWriterStats {
+    size_t pending = 0;     // Evicted chunks waiting to be written
+    uint64_t written = 0;   // Chunks written and freed
+    uint64_t batches = 0;   // Write batches flushed
+    uint64_t reclaimed = 0; // Chunks taken back before their write finished
+};
+
+// Write-behind queue for evicted chunks
+// Owns the chunks handed to it until they're written, then deletes them. Evictions
+// are batched on a dedicated thread so the frame that evicts never touches the disk.
+// Chunks must have released their GPU resources before being submitted.
+class ChunkWriter {
+    struct Entry {
+        Chunk *chunk = nullptr;
+        bool writing = false;   // Part of the batch currently being written
+        bool reclaimed = false; // Taken back while being written, don't delete it
+        bool resubmit = false;  // Submitted again while being written, write it again
+    };
+
+    std::unordered_map<uint64_t, Entry> _pending;
+    std::deque<uint64_t> _order;
+    std::deque<std::function<void()>> _tasks; // Run on the writer thread ahead of the next batch
+    bool _running_tasks = false;
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::thread _thread;
+    bool _stop = false;
+    bool _flush = false;
+
+    std::function<void(const std::vector<Chunk*>&)> _write;
+
+    std::atomic<uint64_t> _written{0};
+    std::atomic<uint64_t> _batches{0};
+    std::atomic<uint64_t> _reclaimed{0};
+
+    void run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            // Wait for a full batch, or write whatever there is once the delay runs out
+            _wake.wait_for(lock, std::chrono::milliseconds(CHUNK_WRITE_DELAY_MS), [this] {
+                return _stop || _flush || !_tasks.empty() || _order.size() >= CHUNK_WRITE_BATCH;
+            });
+            if (!_tasks.empty()) {
+                std::deque<std::function<void()>> tasks;
+                tasks.swap(_tasks);
+                _running_tasks = true;
+                lock.unlock();
+                for (auto& task : tasks)
+                    task();
+                lock.lock();
+                _running_tasks = false;
+            }
+            if (_order.empty() && _tasks.empty()) {
+                _flush = false;
+                _idle.notify_all();
+                if (_stop)
+                    return;
+                continue;
+            }
+
+            std::vector<uint64_t> ids;
+            std::vector<Chunk*> batch;
+            while (!_order.empty() && batch.size() < CHUNK_WRITE_BATCH) {
+                uint64_t id = _order.front();
+                _order.pop_front();
+                auto it = _pending.find(id);
+                if (it == _pending.end() || it->second.writing)
+                    continue;
+                it->second.writing = true;
+                ids.push_back(id);
+                batch.push_back(it->second.chunk);
+            }
+            if (batch.empty())
+                continue;
+
+            lock.unlock();
+            _write(batch);
+            _batches++;
+            lock.lock();
+
+            std::vector<Chunk*> finished;
+            for (uint64_t id : ids) {
+                auto it = _pending.find(id);
+                if (it == _pending.end())
+                    continue;
+                Entry &entry = it->second;
+                entry.writing = false;
+                if (entry.resubmit) {
+                    // Evicted again while we were writing the old copy
+                    entry.resubmit = false;
+                    entry.reclaimed = false;
+                    _order.push_back(id);
+                    continue;
+                }
+                if (!entry.reclaimed)
+                    finished.push_back(entry.chunk);
+                _pending.erase(it);
+            }
+            _written += finished.size();
+            lock.unlock();
+            for (Chunk *chunk : finished)
+                delete chunk;
+            lock.lock();
+            _idle.notify_all();
+        }
+    }
+
+public:
+    ChunkWriter(std::function<void(const std::vector<Chunk*>&)> write)
+        : _write(std::move(write)) {
+        _thread = std::thread([this]() {
+            this->run();
+        });
+    }
+
+    ChunkWriter(const ChunkWriter&) = delete;
+    ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+    ~ChunkWriter() {
+        stop();
+    }
+
+    // Takes ownership of the chunk
+    void submit(Chunk *chunk) {
+        uint64_t id = chunk->id();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _pending.find(id);
+            if (it != _pending.end()) {
+                // Only possible when the old copy was reclaimed mid-write and is the same chunk
+                it->second.chunk = chunk;
+                it->second.resubmit = true;
+            } else {
+                _pending[id] = {chunk};
+                _order.push_back(id);
+            }
+            if (_order.size() < CHUNK_WRITE_BATCH)
+                return;
+        }
+        _wake.notify_one();
+    }
+
+    // Run something on the writer thread, in order with the chunks submitted around it
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(std::move(task));
+        }
+        _wake.notify_one();
+    }
+
+    // Take a chunk back before it's been written, returns nullptr if it isn't pending
+    Chunk* take(uint64_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _pending.find(id);
+        if (it == _pending.end())
+            return nullptr;
+        Entry &entry = it->second;
+        Chunk *chunk = entry.chunk;
+        if (entry.writing && !entry.resubmit) {
+            // The writer only reads from it, leave the entry so the writer knows not to delete it
+            if (entry.reclaimed)
+                return nullptr;
+            entry.reclaimed = true;
+        } else if (entry.writing) {
+            entry.resubmit = false;
+            entry.reclaimed = true;
+        } else
+            _pending.erase(it);
+        _reclaimed++;
+        return chunk;
+    }
+
+    // Block until everything submitted or posted so far has been written
+    void flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_thread.joinable())
+            return;
+        _flush = true;
+        _wake.notify_one();
+        _idle.wait(lock, [this] {
+            return _tasks.empty() && !_running_tasks && (_pending.empty() || (_order.empty() && !_flush));
+        });
+    }
+
+    // Writes everything still pending, then joins the writer thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_one();
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    ChunkWriterStats stats() const {
+        ChunkWriterStats stats;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            stats.pending = _pending.size();
+        }
+        stats.written = _written.load();
+        stats.batches = _batches.load();
+        stats.reclaimed = _reclaimed.load();
+        return stats;
+    }
+};
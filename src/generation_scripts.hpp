@@ -0,0 +1,237 @@
+//
+//  generation_scripts.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "chunk.hpp"
+#include "fmt/format.h"
+#include "sokol/sokol_time.h"
+#include "minilua.h"
+#include <iostream>
+#include <string>
+#include <shared_mutex>
+#include <atomic>
+
+struct GenerationScriptStats {
+    bool loaded = false;
+    uint64_t runs = 0;    // Chunks the hook has run on
+    uint64_t errors = 0;  // Runs that raised an error or went over budget
+    double ms = 0.0;      // Total time spent in the hook
+};
+
+// Runs generate.lua from the package on the worker generating a chunk
+// The world's lua_State belongs to the main thread, so every run gets a fresh sandboxed state
+// instead. The sandbox has the base, string, table, math and utf8 libraries and the tile functions
+// below, but no io, os, package, debug, ECS or graphics, so a script can only touch the chunk it's
+// given. Scripts define generate(chunk_x, chunk_y), which runs once the caves are smoothed:
+//   get_solid(x, y) / set_solid(x, y, solid)   tile coordinates are local to the chunk
+//   get_extra(x, y) / set_extra(x, y, value)
+//   noise(x, y)                                 seeded value in [0, 1), the same every run
+// math.random is seeded from the world seed and chunk, and nothing a run leaves behind (globals,
+// library tables) survives into the next one, so output only depends on the seed and chunks made
+// by the hook can still be thrown away and regenerated instead of saved.
+class GenerationScripts {
+    struct State {
+        lua_State *L = nullptr;
+        Chunk *chunk = nullptr; // Chunk the hook is running on
+        uint64_t seed = 0;
+
+        ~State() {
+            if (L)
+                lua_close(L);
+        }
+    };
+
+    std::string _source;
+    std::string _name;
+    uint64_t _version = 0;
+    std::atomic<uint64_t> _reported{0}; // Last version whose load error was logged
+    mutable std::shared_mutex _lock;
+    std::atomic<uint64_t> _runs{0};
+    std::atomic<uint64_t> _errors{0};
+    std::atomic<uint64_t> _us{0};
+
+    static State* _state_from_lua(lua_State *L) {
+        return static_cast<State*>(lua_touserdata(L, lua_upvalueindex(1)));
+    }
+
+    static void _check_tile(lua_State *L, int &x, int &y) {
+        x = static_cast<int>(luaL_checkinteger(L, 1));
+        y = static_cast<int>(luaL_checkinteger(L, 2));
+        if (x < 0 || x >= CHUNK_WIDTH || y < 0 || y >= CHUNK_HEIGHT)
+            luaL_error(L, "tile (%d, %d) is outside the chunk", x, y);
+    }
+
+    // Sticky once it's gone off, a script that catches the error with pcall hits it again on its
+    // next instruction so it can't keep a worker looping
+    static void _budget_hook(lua_State *L, lua_Debug*) {
+        lua_sethook(L, _budget_hook, LUA_MASKCOUNT, 1);
+        luaL_error(L, "generate.lua ran over its budget of %d instructions", GENERATION_SCRIPT_BUDGET);
+    }
+
+    static void _register(lua_State *L, State *state, const char *name, lua_CFunction fn) {
+        lua_pushlightuserdata(L, state);
+        lua_pushcclosure(L, fn, 1);
+        lua_setglobal(L, name);
+    }
+
+    static lua_State* _sandbox(State *state) {
+        lua_State *L = luaL_newstate();
+        const luaL_Reg libs[] = {
+            {LUA_GNAME, luaopen_base},
+            {LUA_STRLIBNAME, luaopen_string},
+            {LUA_TABLIBNAME, luaopen_table},
+            {LUA_MATHLIBNAME, luaopen_math},
+            {LUA_UTF8LIBNAME, luaopen_utf8}
+        };
+        for (const auto& lib : libs) {
+            luaL_requiref(L, lib.name, lib.func, 1);
+            lua_pop(L, 1);
+        }
+        // Nothing that reaches the filesystem or loads precompiled chunks
+        for (const char *name : {"dofile", "loadfile", "load", "require"}) {
+            lua_pushnil(L);
+            lua_setglobal(L, name);
+        }
+        lua_pushinteger(L, CHUNK_WIDTH);
+        lua_setglobal(L, "CHUNK_WIDTH");
+        lua_pushinteger(L, CHUNK_HEIGHT);
+        lua_setglobal(L, "CHUNK_HEIGHT");
+
+        _register(L, state, "get_solid", [](lua_State *L) -> int {
+            int x, y;
+            _check_tile(L, x, y);
+            auto tile = _state_from_lua(L)->chunk->tile(x, y);
+            lua_pushboolean(L, tile && tile->solid);
+            return 1;
+        });
+        _register(L, state, "set_solid", [](lua_State *L) -> int {
+            int x, y;
+            _check_tile(L, x, y);
+            luaL_checktype(L, 3, LUA_TBOOLEAN);
+            lua_pushboolean(L, _state_from_lua(L)->chunk->set_solid(x, y, lua_toboolean(L, 3), true));
+            return 1;
+        });
+        _register(L, state, "get_extra", [](lua_State *L) -> int {
+            int x, y;
+            _check_tile(L, x, y);
+            auto tile = _state_from_lua(L)->chunk->tile(x, y);
+            lua_pushinteger(L, tile ? tile->extra : 0);
+            return 1;
+        });
+        _register(L, state, "set_extra", [](lua_State *L) -> int {
+            int x, y;
+            _check_tile(L, x, y);
+            lua_Integer value = luaL_checkinteger(L, 3);
+            if (value < 0 || value > 255)
+                return luaL_error(L, "extra value %d is out of range (0-255)", static_cast<int>(value));
+            lua_pushboolean(L, _state_from_lua(L)->chunk->set_extra(x, y, static_cast<uint8_t>(value), true));
+            return 1;
+        });
+        _register(L, state, "noise", [](lua_State *L) -> int {
+            State *state = _state_from_lua(L);
+            int64_t x = static_cast<int64_t>(state->chunk->x()) * CHUNK_WIDTH + luaL_checkinteger(L, 1);
+            int64_t y = static_cast<int64_t>(state->chunk->y()) * CHUNK_HEIGHT + luaL_checkinteger(L, 2);
+            lua_pushnumber(L, Chunk::noise(state->seed ^ 0x67656E65726174ULL, x, y));
+            return 1;
+        });
+        return L;
+    }
+
+    // Build a sandbox with the current script run in it. A broken script fails the same way on
+    // every chunk, so its errors are only logged once per version. _lock must be held shared
+    bool _prepare(State &state) {
+        state.L = _sandbox(&state);
+        lua_State *L = state.L;
+        // Seeded before the script runs so its top level is as repeatable as generate()
+        lua_getglobal(L, "math");
+        lua_getfield(L, -1, "randomseed");
+        lua_pushinteger(L, static_cast<lua_Integer>(state.seed ^ state.chunk->id()));
+        lua_call(L, 1, 0);
+        lua_pop(L, 1);
+        bool report = _reported.exchange(_version) != _version;
+        bool ready = false;
+        lua_sethook(L, _budget_hook, LUA_MASKCOUNT, GENERATION_SCRIPT_BUDGET);
+        if (luaL_loadbufferx(L, _source.data(), _source.size(), _name.c_str(), "t") != LUA_OK ||
+            lua_pcall(L, 0, 0, 0) != LUA_OK) {
+            if (report)
+                std::cout << fmt::format("Lua error in {}: {}\n", _name, lua_tostring(L, -1));
+            lua_pop(L, 1);
+        } else if (lua_getglobal(L, "generate") != LUA_TFUNCTION) {
+            if (report)
+                std::cout << fmt::format("Warning: {} doesn't define generate(chunk_x, chunk_y)\n", _name);
+            lua_pop(L, 1);
+        } else {
+            lua_pop(L, 1);
+            ready = true;
+        }
+        lua_sethook(L, nullptr, 0, 0);
+        return ready;
+    }
+
+public:
+    GenerationScripts() = default;
+    GenerationScripts(const GenerationScripts&) = delete;
+    GenerationScripts& operator=(const GenerationScripts&) = delete;
+
+    // Replace the script, it's picked up by the next chunk generated
+    void load(const std::string &source, const std::string &name) {
+        std::unique_lock<std::shared_mutex> lock(_lock);
+        _source = source;
+        _name = name;
+        _version++;
+    }
+
+    bool loaded() const {
+        std::shared_lock<std::shared_mutex> lock(_lock);
+        return _version != 0 && !_source.empty();
+    }
+
+    // Run generate() on a chunk in a state of its own, errors are logged and leave whatever the
+    // script wrote before failing. Returns false if there's nothing to run or it failed
+    bool run(Chunk *chunk, uint64_t seed) {
+        if (!loaded())
+            return false;
+        uint64_t start = stm_now();
+        State state;
+        state.chunk = chunk;
+        state.seed = seed;
+        {
+            std::shared_lock<std::shared_mutex> lock(_lock);
+            if (!_prepare(state))
+                return false;
+        }
+
+        lua_State *L = state.L;
+        lua_getglobal(L, "generate");
+        lua_pushinteger(L, chunk->x());
+        lua_pushinteger(L, chunk->y());
+        lua_sethook(L, _budget_hook, LUA_MASKCOUNT, GENERATION_SCRIPT_BUDGET);
+        bool ok = lua_pcall(L, 2, 0, 0) == LUA_OK;
+        lua_sethook(L, nullptr, 0, 0);
+        if (!ok) {
+            std::shared_lock<std::shared_mutex> lock(_lock);
+            std::cout << fmt::format("Lua error in {} for chunk ({}, {}): {}\n", _name,
+                                     chunk->x(), chunk->y(), lua_tostring(L, -1));
+            lua_pop(L, 1);
+            _errors++;
+        }
+        _us += static_cast<uint64_t>(stm_us(stm_since(start)));
+        _runs++;
+        return ok;
+    }
+
+    GenerationScriptStats stats() const {
+        GenerationScriptStats stats;
+        stats.loaded = loaded();
+        stats.runs = _runs.load();
+        stats.errors = _errors.load();
+        stats.ms = _us.load() / 1000.0;
+        return stats;
+    }
+};
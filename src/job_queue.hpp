@@ -18,6 +18,9 @@
 #include <thread>
 #include <unordered_set>
 #include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
+#include "thread_pool.hpp"
 
 template<typename T>
 class UnorderedSet {
@@ -57,101 +60,78 @@ public:
     }
 };
 
+// Front-end for a processor function, the work itself runs on the shared ThreadPool
 template<typename T>
 class JobQueue {
-    std::deque<T> _queue;
-    std::deque<T> _priority_queue;
-    mutable std::mutex _queue_mutex;
-    std::condition_variable _condition;
-    std::atomic<bool> _stop{false};
-    std::vector<std::thread> _worker_threads;
     std::function<void(T)> _processor;
+    std::function<void(T)> _skipped;
+    std::atomic<bool> _stop{false};
+    std::atomic<size_t> _queued{0};
+    std::atomic<size_t> _queued_priority{0};
+    std::atomic<size_t> _running{0};
+    std::mutex _idle_mutex;
+    std::condition_variable _idle;
+
+    void finish() {
+        if (_queued.load() == 0 && _queued_priority.load() == 0 && _running.load() == 0) {
+            std::lock_guard<std::mutex> lock(_idle_mutex);
+            _idle.notify_all();
+        }
+    }
 
-    void worker_loop() {
-        while (true) {
-            std::unique_lock<std::mutex> lock(this->_queue_mutex);
-            
-            // Use timeout to prevent indefinite blocking during shutdown
-            if (!this->_condition.wait_for(lock, std::chrono::milliseconds(100), [this] {
-                return this->_stop.load() || !this->_priority_queue.empty() || !this->_queue.empty();
-            })) {
-                // Timeout occurred, check if we should stop
-                if (this->_stop.load())
-                    return;
-                continue;
-            }
-            
-            if (this->_stop.load() && this->_priority_queue.empty() && this->_queue.empty())
-                return;
-            
-            T item;
-            bool has_item = false;
-            
-            // Process priority queue first
-            if (!this->_priority_queue.empty()) {
-                item = std::move(this->_priority_queue.front());
-                this->_priority_queue.pop_front();
-                has_item = true;
-            } else if (!this->_queue.empty()) {
-                item = std::move(this->_queue.front());
-                this->_queue.pop_front();
-                has_item = true;
-            }
-            
-            lock.unlock(); // Release lock before processing
-            if (has_item)
-                this->_processor(item);
+    void skip(T item) {
+        if (_skipped)
+            _skipped(std::move(item));
+    }
+
+    void submit(T item, JobPriority priority, bool front = false) {
+        std::atomic<size_t> &counter = priority == JobPriority::High ? _queued_priority : _queued;
+        counter++;
+        if (_stop.load()) {
+            counter--;
+            skip(std::move(item));
+            finish();
+            return;
         }
+        $Pool.submit([this, &counter, item = std::move(item)]() mutable {
+            // Count as running before leaving the queue so stop() never sees a gap
+            _running++;
+            counter--;
+            if (!_stop.load())
+                _processor(std::move(item));
+            else
+                skip(std::move(item));
+            _running--;
+            finish();
+        }, priority, front);
     }
 
 public:
-    explicit JobQueue(std::function<void(T)> processor, size_t num_threads = 1) 
-        : _processor(std::move(processor)) {
-        _worker_threads.reserve(num_threads);
-        for (size_t i = 0; i < num_threads; ++i) {
-            _worker_threads.emplace_back([this]() {
-                this->worker_loop();
-            });
-        }
+    // skipped is given anything dropped by stop() or pushed after it, in place of the processor
+    explicit JobQueue(std::function<void(T)> processor, std::function<void(T)> skipped = nullptr)
+        : _processor(std::move(processor))
+        , _skipped(std::move(skipped)) {
+        // Make sure the pool outlives this queue
+        ThreadPool::instance();
     }
 
     JobQueue(const JobQueue&) = delete;
     JobQueue& operator=(const JobQueue&) = delete;
-    JobQueue(JobQueue&& other) noexcept
-        : _queue(std::move(other._queue))
-        , _priority_queue(std::move(other._priority_queue))
-        , _processor(std::move(other._processor))
-        , _stop(other._stop.load()) {
-        if (!other._worker_threads.empty())
-            _worker_threads = std::move(other._worker_threads);
-    }
 
     ~JobQueue() {
         stop();
     }
 
     void push(T item) {
-        {
-            std::lock_guard<std::mutex> lock(_queue_mutex);
-            _queue.push_back(std::move(item));
-        }
-        _condition.notify_one();
+        submit(std::move(item), JobPriority::Normal);
     }
 
     void push_front(T item) {
-        {
-            std::lock_guard<std::mutex> lock(_queue_mutex);
-            _queue.push_front(std::move(item));
-        }
-        _condition.notify_one();
+        submit(std::move(item), JobPriority::Normal, true);
     }
 
     void push_priority(T item) {
-        {
-            std::lock_guard<std::mutex> lock(_queue_mutex);
-            _priority_queue.push_back(std::move(item));
-        }
-        _condition.notify_one();
+        submit(std::move(item), JobPriority::High);
     }
 
     void enqueue(T item) {
@@ -162,56 +142,69 @@ public:
         push_priority(std::move(item));
     }
 
+    // Stop accepting work and wait for anything in flight, queued jobs are handed to skipped
     void stop() {
-        {
-            std::lock_guard<std::mutex> lock(_queue_mutex);
-            _stop.store(true);
-        }
-        _condition.notify_all();
-        for (auto& worker : _worker_threads)
-            if (worker.joinable())
-                worker.join();
-        _worker_threads.clear();
+        _stop.store(true);
+        std::unique_lock<std::mutex> lock(_idle_mutex);
+        while (_queued.load() != 0 || _queued_priority.load() != 0 || _running.load() != 0)
+            _idle.wait_for(lock, std::chrono::milliseconds(100));
     }
 
     bool empty() const {
-        std::lock_guard<std::mutex> lock(_queue_mutex);
-        return _queue.empty() && _priority_queue.empty();
+        return _queued.load() == 0 && _queued_priority.load() == 0;
     }
 
     size_t size() const {
-        std::lock_guard<std::mutex> lock(_queue_mutex);
-        return _queue.size() + _priority_queue.size();
+        return _queued.load() + _queued_priority.load();
     }
 
     size_t worker_count() const {
-        return _worker_threads.size();
+        return $Pool.worker_count();
     }
 
     size_t pending_jobs() const {
-        std::lock_guard<std::mutex> lock(_queue_mutex);
-        return _queue.size();
+        return _queued.load();
     }
 
     size_t pending_priority_jobs() const {
-        std::lock_guard<std::mutex> lock(_queue_mutex);
-        return _priority_queue.size();
+        return _queued_priority.load();
+    }
+
+    size_t running_jobs() const {
+        return _running.load();
     }
 };
 
-class GenericJobQueue : public JobQueue<std::function<void()>> {
+// Jobs are called with false instead of run when they're skipped, so their future gets an error
+// rather than a broken promise
+class GenericJobQueue : public JobQueue<std::function<void(bool)>> {
 public:
-    explicit GenericJobQueue(size_t num_threads = std::thread::hardware_concurrency()) 
-        : JobQueue<std::function<void()>>([](std::function<void()> f) { f(); }, num_threads) {}
+    GenericJobQueue()
+        : JobQueue<std::function<void(bool)>>([](std::function<void(bool)> f) { f(true); },
+                                              [](std::function<void(bool)> f) { f(false); }) {}
 
     template<class F, class... Args> 
     auto enqueue(bool priority, F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
         using return_type = typename std::invoke_result<F, Args...>::type;
-        auto job = std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
-        std::future<return_type> result = job->get_future();
-        std::function<void()> task = [job]() { (*job)(); };
+        auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        auto job = std::make_shared<decltype(bound)>(std::move(bound));
+        auto promise = std::make_shared<std::promise<return_type>>();
+        std::future<return_type> result = promise->get_future();
+        std::function<void(bool)> task = [job, promise](bool run) {
+            if (!run) {
+                promise->set_exception(std::make_exception_ptr(std::runtime_error("Job queue stopped before the job ran")));
+                return;
+            }
+            try {
+                if constexpr (std::is_void_v<return_type>) {
+                    (*job)();
+                    promise->set_value();
+                } else
+                    promise->set_value((*job)());
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        };
         if (priority)
             push_priority(std::move(task));
         else
@@ -27,6 +27,8 @@
 #include "passthru.glsl.h"
 #include "input_manager.hpp"
 #include "world.hpp"
+#include "benchmark.hpp"
+#include "argparse.hpp"
 
 static struct {
     sg_pipeline pipeline;
@@ -208,6 +210,54 @@ static void frame(void) {
     sdtx_printf("tile:   (%d, %d)\n", (int)mouse_tile.x, (int)mouse_tile.y);
     Rect bounds = state.world->camera()->bounds();
     sdtx_printf("camera: (%d, %d, %d, %d)\n", bounds.x, bounds.y, bounds.x + bounds.w, bounds.y + bounds.h);
+    size_t chunk_count = 0;
+    ChunkMemoryStats chunk_memory = $Chunks.memory_stats(&chunk_count);
+    sdtx_printf("chunks: %zu (tiles %.1fMB, cpu %.1fMB, gpu %.1fMB)\n", chunk_count,
+                chunk_memory.tile_bytes / (1024.f * 1024.f),
+                chunk_memory.cpu_vertex_bytes / (1024.f * 1024.f),
+                chunk_memory.gpu_vertex_bytes / (1024.f * 1024.f));
+    auto lifecycle = $Chunks.lifecycle_stats();
+    sdtx_printf(" ");
+    for (size_t i = 0; i < lifecycle.size(); i++)
+        sdtx_printf(" %zu %s", lifecycle[i], ChunkSlot::state_to_string(static_cast<ChunkLifecycle>(i)));
+    sdtx_printf("\n");
+    ChunkDrawStats draws = $Chunks.draw_stats();
+    sdtx_printf("draw:   %zu chunks, %zu vertices, %zu culled (%s)\n", draws.draws, draws.vertices, draws.culled,
+                draws.overview ? "overview" : $Chunks.tilemap_rendering() ? "tilemap" : "vertices");
+    sdtx_printf("jobs:   %zu workers, %zu pending, %llu stolen\n", $Pool.worker_count(), $Pool.pending_jobs(),
+                (unsigned long long)$Pool.stolen_jobs());
+    ChunkRequestStats requests = $Chunks.request_stats();
+    sdtx_printf("queue:  %zu pending, %llu done, %llu cancelled, %llu wasted\n", requests.pending,
+                (unsigned long long)requests.completed, (unsigned long long)requests.cancelled,
+                (unsigned long long)requests.wasted);
+    ChunkUploadStats uploads = $Chunks.upload_stats();
+    sdtx_printf("upload: %zu chunks, %.1fKB, %.2fms (%zu waiting)\n", uploads.uploaded,
+                uploads.bytes / 1024.f, uploads.ms, uploads.pending);
+    ChunkLoadStats loads = $Chunks.load_stats();
+    sdtx_printf("loads: %llu mapped (%.3fms avg), %llu stream (%.3fms avg)\n",
+                (unsigned long long)loads.mapped_loads, loads.mapped_loads ? loads.mapped_ms / loads.mapped_loads : 0.0,
+                (unsigned long long)loads.stream_loads, loads.stream_loads ? loads.stream_ms / loads.stream_loads : 0.0);
+    ChunkPipelineStats pipeline = $Chunks.pipeline_stats();
+    sdtx_printf("gen:    %zu waiting on neighbours\n", pipeline.waiting);
+    for (const auto& [stage, stats] : pipeline.stages)
+        sdtx_printf("  %-9s %zu queued, %llu done (%.3fms avg)\n", Chunk::stage_to_string(stage), stats.queued,
+                    (unsigned long long)stats.runs, stats.runs ? stats.ms / stats.runs : 0.0);
+    GenerationScriptStats scripts = $Chunks.script_stats();
+    if (scripts.loaded)
+        sdtx_printf("  %-9s %llu run, %llu failed (%.3fms avg)\n", "script", (unsigned long long)scripts.runs,
+                    (unsigned long long)scripts.errors, scripts.runs ? scripts.ms / scripts.runs : 0.0);
+    ChunkCacheStats cache = $Chunks.cache_stats();
+    sdtx_printf("cache:  %zu chunks, %.1f/%.1fMB, %llu hits, %llu misses\n", cache.entries,
+                cache.bytes / (1024.f * 1024.f), cache.budget / (1024.f * 1024.f),
+                (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+    ChunkWriterStats writes = $Chunks.writer_stats();
+    RegionStoreStats saves = $Chunks.save_stats();
+    sdtx_printf("writes: %zu pending, %llu saved (%.1fKB), %llu unchanged, %llu reclaimed\n", writes.pending,
+                (unsigned long long)saves.saved, saves.bytes / 1024.f, (unsigned long long)saves.skipped,
+                (unsigned long long)writes.reclaimed);
+    WorldSaverStats archive = $Chunks.archive_stats();
+    sdtx_printf("save:   %zu pending, %llu appended (%.1fKB), %zu/%zu live entries\n", archive.pending,
+                (unsigned long long)archive.appended, archive.bytes / 1024.f, archive.chunks, archive.entries);
 
     sg_begin_pass(&state.pass);
     if (!state.world->update(sapp_frame_duration()))
@@ -242,6 +292,34 @@ static void cleanup(void) {
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
+    argparse::ArgumentParser program("nice");
+
+    program.add_argument("-b", "--benchmark")
+        .help("Run a headless benchmark and exit (\"list\" to show them, \"all\" to run every one)")
+        .default_value("");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << program;
+        exit(1);
+    }
+
+    std::string benchmark = program.get<std::string>("--benchmark");
+    if (!benchmark.empty()) {
+        try {
+            if (!run_benchmark(benchmark)) {
+                std::cerr << fmt::format("Unknown benchmark: {}\n", benchmark);
+                exit(1);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << fmt::format("Benchmark failed: {}\n", e.what());
+            exit(1);
+        }
+        exit(0);
+    }
+
     return (sapp_desc) {
         .width = DEFAULT_WINDOW_WIDTH,
         .height = DEFAULT_WINDOW_HEIGHT,
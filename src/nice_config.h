@@ -17,9 +17,47 @@
 #define CHUNK_SMOOTH_ITERATIONS 5
 #define CHUNK_SURVIVE 4
 #define CHUNK_STARVE 3
+// Generated decorations are at least this many tiles apart
+#define CHUNK_DECORATION_RADIUS 6
+// At most one entity spawn point in every square of this many tiles
+#define CHUNK_SPAWN_SPACING 32
+// Lua instructions generate.lua may run per chunk before it's stopped
+#define GENERATION_SCRIPT_BUDGET 10000000
 
 #define CHUNK_DELETION_TIMEOUT 5
 
+// Per-frame limits for moving finished chunk meshes onto the GPU
+#define CHUNK_UPLOAD_BUDGET_BYTES (4 * 1024 * 1024)
+#define CHUNK_UPLOAD_BUDGET_MS 2.0
+// Draw chunks as one quad over a tile index image, 0 = six vertices for every solid tile
+#define CHUNK_TILEMAP_RENDERING 1
+// Below this zoom chunks are drawn from overviews with one texel for every SCALE x SCALE tiles
+#define CHUNK_OVERVIEW_ZOOM .5f
+#define CHUNK_OVERVIEW_SCALE 2
+// Evicted chunks are written in batches of this size, or after this delay
+#define CHUNK_WRITE_BATCH 16
+#define CHUNK_WRITE_DELAY_MS 250
+// Evicted chunks stay in RAM compressed until they take up more than this
+#define CHUNK_CACHE_BUDGET_BYTES (32 * 1024 * 1024)
+
+// Chunks are saved in region files of REGION_SIZE x REGION_SIZE chunks
+#define REGION_SIZE 32
+#define REGION_SECTOR_SIZE 4096
+// Format used when saving chunks, version 1 files can always be read
+#define CHUNK_FORMAT_VERSION 2
+// Decode chunks straight out of mmap'd region files, 0 = read through std::istream
+#define CHUNK_MMAP_LOADING 1
+// Deflate level for chunks saved to the .niceworld archive
+#define WORLD_ARCHIVE_LEVEL 6
+// Rewrite the archive once superseded entries outnumber live ones, and there are at least this many
+#define WORLD_ARCHIVE_COMPACT_MIN 256
+
+// Number of generated chunks used by the headless benchmarks
+#define BENCHMARK_CHUNK_COUNT 64
+
+// 0 = one worker per core, minus one for the main thread
+#define THREAD_POOL_WORKERS 0
+
 #define TILE_PADDING 4
 
 #define MAX_ZOOM 2.f
@@ -0,0 +1,452 @@
+//
+//  region_file.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "chunk.hpp"
+#include "fmt/format.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <filesystem>
+#include <mutex>
+#include <memory>
+#include <stdexcept>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define REGION_MAGIC 0x4745524E // "NREG"
+#define REGION_VERSION 1
+#define REGION_EXTENSION ".niceregion"
+
+// Read-only mapping of a whole region file
+// Shared so a chunk being decoded keeps its mapping alive if the file grows and gets remapped
+struct RegionMapping {
+    void *address = MAP_FAILED;
+    size_t length = 0;
+
+    ~RegionMapping() {
+        if (address != MAP_FAILED)
+            munmap(address, length);
+    }
+};
+
+// A chunk's bytes inside a mapped region file
+struct RegionView {
+    std::shared_ptr<RegionMapping> mapping;
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+};
+
+// One file holding a REGION_SIZE x REGION_SIZE block of chunks
+// The file is split into REGION_SECTOR_SIZE sectors. The first few hold the header
+// and a slot table with the sector offset and byte length of every chunk, the rest
+// hold chunk data. A chunk that still fits in its old sectors is rewritten in place,
+// otherwise it moves to the first free run big enough (or the end of the file).
+class RegionFile {
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t sector_size;
+    };
+
+    struct Slot {
+        uint32_t sector; // 0 = empty
+        uint32_t length; // Bytes
+    };
+
+    static constexpr int SLOT_COUNT = REGION_SIZE * REGION_SIZE;
+    static constexpr uint32_t TABLE_SECTORS = (sizeof(Header) + sizeof(Slot) * SLOT_COUNT + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+
+    int _fd = -1;
+    std::string _path;
+    Slot _slots[SLOT_COUNT];
+    std::vector<bool> _used; // Per sector
+    bool _dirty = false;
+    mutable std::shared_ptr<RegionMapping> _mapping;
+    mutable std::mutex _mutex;
+
+    // Map the file again when it has grown past the current mapping
+    bool remap(size_t required) const {
+        if (_mapping && _mapping->length >= required)
+            return true;
+        struct stat st;
+        if (fstat(_fd, &st) != 0 || static_cast<size_t>(st.st_size) < required)
+            return false;
+        auto mapping = std::make_shared<RegionMapping>();
+        mapping->address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (mapping->address == MAP_FAILED)
+            return false;
+        mapping->length = st.st_size;
+        _mapping = mapping;
+        return true;
+    }
+
+    static uint32_t sectors_for(size_t length) {
+        return static_cast<uint32_t>((length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE);
+    }
+
+    void mark(uint32_t sector, uint32_t count, bool used) {
+        if (sector + count > _used.size())
+            _used.resize(sector + count, false);
+        for (uint32_t i = 0; i < count; i++)
+            _used[sector + i] = used;
+    }
+
+    uint32_t allocate(uint32_t count) {
+        uint32_t run = 0;
+        for (uint32_t i = TABLE_SECTORS; i < _used.size(); i++) {
+            run = _used[i] ? 0 : run + 1;
+            if (run == count)
+                return i - count + 1;
+        }
+        // No gap big enough, grow the file (reusing any free tail)
+        return static_cast<uint32_t>(_used.size()) - run;
+    }
+
+    void write_at(const void *data, size_t length, off_t offset) {
+        const char *ptr = static_cast<const char*>(data);
+        while (length > 0) {
+            ssize_t written = pwrite(_fd, ptr, length, offset);
+            if (written < 0)
+                throw std::runtime_error(fmt::format("Failed to write region file: {}", _path));
+            ptr += written;
+            offset += written;
+            length -= written;
+        }
+    }
+
+    void read_at(void *data, size_t length, off_t offset) const {
+        char *ptr = static_cast<char*>(data);
+        while (length > 0) {
+            ssize_t got = pread(_fd, ptr, length, offset);
+            if (got <= 0)
+                throw std::runtime_error(fmt::format("Failed to read region file: {}", _path));
+            ptr += got;
+            offset += got;
+            length -= got;
+        }
+    }
+
+    void write_slot(int slot) {
+        write_at(&_slots[slot], sizeof(Slot), sizeof(Header) + slot * sizeof(Slot));
+    }
+
+public:
+    RegionFile(const std::string &path): _path(path) {
+        _fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (_fd < 0)
+            throw std::runtime_error(fmt::format("Failed to open region file: {}", path));
+
+        struct stat st;
+        fstat(_fd, &st);
+        if (st.st_size == 0) {
+            Header header = {
+                .magic = REGION_MAGIC,
+                .version = REGION_VERSION,
+                .size = REGION_SIZE,
+                .sector_size = REGION_SECTOR_SIZE
+            };
+            memset(_slots, 0, sizeof(_slots));
+            std::vector<char> table(TABLE_SECTORS * REGION_SECTOR_SIZE, 0);
+            memcpy(table.data(), &header, sizeof(Header));
+            write_at(table.data(), table.size(), 0);
+            _dirty = true;
+        } else {
+            Header header;
+            read_at(&header, sizeof(Header), 0);
+            if (header.magic != REGION_MAGIC)
+                throw std::runtime_error(fmt::format("Invalid region file (bad magic): {}", path));
+            if (header.version != REGION_VERSION || header.size != REGION_SIZE || header.sector_size != REGION_SECTOR_SIZE)
+                throw std::runtime_error(fmt::format("Unsupported region file layout: {}", path));
+            read_at(_slots, sizeof(_slots), sizeof(Header));
+        }
+
+        mark(0, TABLE_SECTORS, true);
+        for (const Slot &slot : _slots)
+            if (slot.sector != 0)
+                mark(slot.sector, sectors_for(slot.length), true);
+    }
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile& operator=(const RegionFile&) = delete;
+
+    ~RegionFile() {
+        if (_fd >= 0) {
+            sync();
+            close(_fd);
+        }
+    }
+
+    static int slot_index(int lx, int ly) {
+        return ly * REGION_SIZE + lx;
+    }
+
+    bool contains(int lx, int ly) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _slots[slot_index(lx, ly)].sector != 0;
+    }
+
+    bool read(int lx, int ly, std::string &out) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Slot &slot = _slots[slot_index(lx, ly)];
+        if (slot.sector == 0)
+            return false;
+        out.resize(slot.length);
+        read_at(out.data(), slot.length, static_cast<off_t>(slot.sector) * REGION_SECTOR_SIZE);
+        return true;
+    }
+
+    // Zero-copy access to a chunk's bytes, falls back to false if the file can't be mapped
+    bool view(int lx, int ly, RegionView &out) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Slot &slot = _slots[slot_index(lx, ly)];
+        if (slot.sector == 0)
+            return false;
+        size_t offset = static_cast<size_t>(slot.sector) * REGION_SECTOR_SIZE;
+        if (!remap(offset + slot.length))
+            return false;
+        out.mapping = _mapping;
+        out.data = static_cast<const uint8_t*>(_mapping->address) + offset;
+        out.length = slot.length;
+        return true;
+    }
+
+    void write(int lx, int ly, const std::string &data) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        int index = slot_index(lx, ly);
+        Slot &slot = _slots[index];
+        uint32_t needed = sectors_for(data.size());
+        uint32_t current = slot.sector != 0 ? sectors_for(slot.length) : 0;
+        uint32_t sector = slot.sector;
+        if (needed > current) {
+            if (current > 0)
+                mark(slot.sector, current, false);
+            sector = allocate(needed);
+        } else if (current > needed)
+            // Rewritten in place, hand back the sectors we don't need anymore
+            mark(slot.sector + needed, current - needed, false);
+        mark(sector, needed, true);
+
+        write_at(data.data(), data.size(), static_cast<off_t>(sector) * REGION_SECTOR_SIZE);
+        slot.sector = sector;
+        slot.length = static_cast<uint32_t>(data.size());
+        write_slot(index);
+        _dirty = true;
+    }
+
+    // Chunks in local region coordinates
+    std::vector<std::pair<int, int>> chunks() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::pair<int, int>> result;
+        for (int i = 0; i < SLOT_COUNT; i++)
+            if (_slots[i].sector != 0)
+                result.push_back({i % REGION_SIZE, i / REGION_SIZE});
+        return result;
+    }
+
+    void sync() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_dirty)
+            return;
+        fsync(_fd);
+        _dirty = false;
+    }
+};
+
+struct RegionStoreStats {
+    uint64_t saved = 0;   // Chunks written
+    uint64_t skipped = 0; // Chunks that matched what's on disk (or were pure generator output)
+    uint64_t bytes = 0;   // Bytes written
+};
+
+// Every region file of a world, opened on demand and kept open
+class RegionStore {
+    std::filesystem::path _directory;
+    std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> _regions;
+    std::mutex _mutex;
+    std::atomic<uint64_t> _saved{0};
+    std::atomic<uint64_t> _skipped{0};
+    std::atomic<uint64_t> _bytes{0};
+
+    static int floor_div(int v, int d) {
+        return v >= 0 ? v / d : -((-v + d - 1) / d);
+    }
+
+    static uint64_t region_key(int rx, int ry) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(rx)) << 32) | static_cast<uint32_t>(ry);
+    }
+
+    std::filesystem::path region_path(int rx, int ry) const {
+        return _directory / fmt::format("r.{}.{}{}", rx, ry, REGION_EXTENSION);
+    }
+
+    // Returns nullptr when the region doesn't exist and create is false
+    RegionFile* region(int rx, int ry, bool create) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t key = region_key(rx, ry);
+        auto it = _regions.find(key);
+        if (it != _regions.end())
+            return it->second.get();
+        std::filesystem::path path = region_path(rx, ry);
+        if (!create && !std::filesystem::exists(path))
+            return nullptr;
+        RegionFile *file = new RegionFile(path.string());
+        _regions[key] = std::unique_ptr<RegionFile>(file);
+        return file;
+    }
+
+    RegionFile* region_for_chunk(int x, int y, bool create, int &lx, int &ly) {
+        int rx = floor_div(x, REGION_SIZE);
+        int ry = floor_div(y, REGION_SIZE);
+        lx = x - rx * REGION_SIZE;
+        ly = y - ry * REGION_SIZE;
+        return region(rx, ry, create);
+    }
+
+public:
+    RegionStore(const std::string &directory): _directory(directory) {
+        std::filesystem::create_directories(_directory);
+    }
+
+    RegionStore(const RegionStore&) = delete;
+    RegionStore& operator=(const RegionStore&) = delete;
+
+    const std::filesystem::path& directory() const {
+        return _directory;
+    }
+
+    bool contains(int x, int y) {
+        int lx, ly;
+        RegionFile *file = region_for_chunk(x, y, false, lx, ly);
+        return file != nullptr && file->contains(lx, ly);
+    }
+
+    // Raw serialized chunk, returns false if the chunk has never been saved
+    bool read(int x, int y, std::string &data) {
+        int lx, ly;
+        RegionFile *file = region_for_chunk(x, y, false, lx, ly);
+        return file != nullptr && file->read(lx, ly, data);
+    }
+
+    // Returns false if the chunk has never been saved
+    bool load(Chunk *chunk) {
+        std::string data;
+        if (!read(chunk->x(), chunk->y(), data))
+            return false;
+        std::istringstream stream(data);
+        chunk->deserialize(stream);
+        return true;
+    }
+
+    // Same as load() but decodes straight out of the mapped region file
+    bool load_mapped(Chunk *chunk) {
+        int lx, ly;
+        RegionFile *file = region_for_chunk(chunk->x(), chunk->y(), false, lx, ly);
+        if (file == nullptr)
+            return false;
+        RegionView view;
+        if (!file->view(lx, ly, view))
+            return file->contains(lx, ly) && load(chunk);
+        chunk->deserialize(view.data, view.length);
+        return true;
+    }
+
+    // Already serialized chunks, the chunk (if any) is marked saved at the revision the data was encoded from
+    struct Write {
+        int x, y;
+        std::string data;
+        Chunk *chunk = nullptr;
+        uint64_t revision = 0;
+    };
+
+    // Writes every chunk that has changed since it was last saved, then syncs each touched region once
+    void save(const std::vector<Write> &writes) {
+        std::unordered_set<RegionFile*> touched;
+        for (const Write &write : writes) {
+            if (write.data.empty())
+                continue;
+            int lx, ly;
+            RegionFile *file = region_for_chunk(write.x, write.y, true, lx, ly);
+            file->write(lx, ly, write.data);
+            if (write.chunk)
+                write.chunk->mark_saved(write.revision);
+            touched.insert(file);
+            _saved++;
+            _bytes += write.data.size();
+        }
+        for (RegionFile *file : touched)
+            file->sync();
+    }
+
+    void save(const std::vector<Chunk*> &chunks) {
+        std::vector<Write> writes;
+        for (Chunk *chunk : chunks) {
+            if (!chunk->needs_save()) {
+                _skipped++;
+                continue;
+            }
+            uint64_t revision = chunk->revision();
+            writes.push_back({chunk->x(), chunk->y(), chunk->encode(), chunk, revision});
+        }
+        save(writes);
+    }
+
+    // Count a chunk that didn't need writing
+    void skip() {
+        _skipped++;
+    }
+
+    void save(Chunk *chunk) {
+        save(std::vector<Chunk*>{chunk});
+    }
+
+    // Every saved chunk across all region files in the directory
+    std::vector<std::pair<int, int>> chunks() {
+        std::vector<std::pair<int, int>> result;
+        for (const auto& entry : std::filesystem::directory_iterator(_directory)) {
+            if (!entry.is_regular_file() || entry.path().extension() != REGION_EXTENSION)
+                continue;
+            int rx, ry;
+            if (sscanf(entry.path().filename().string().c_str(), "r.%d.%d", &rx, &ry) != 2)
+                continue;
+            RegionFile *file = region(rx, ry, false);
+            if (file == nullptr)
+                continue;
+            for (auto [lx, ly] : file->chunks())
+                result.push_back({rx * REGION_SIZE + lx, ry * REGION_SIZE + ly});
+        }
+        return result;
+    }
+
+    RegionStoreStats stats() const {
+        RegionStoreStats stats;
+        stats.saved = _saved.load();
+        stats.skipped = _skipped.load();
+        stats.bytes = _bytes.load();
+        return stats;
+    }
+
+    void sync() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& [key, file] : _regions)
+            file->sync();
+    }
+
+    // Close every region file, e.g. before the directory is archived
+    void close_all() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _regions.clear();
+    }
+};
@@ -0,0 +1,204 @@
+//
+//  thread_pool.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "global.hpp"
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+
+#define $Pool ThreadPool::instance()
+
+enum class JobPriority {
+    High,
+    Normal
+};
+
+// Shared work-stealing scheduler, every job queue in the engine submits to this
+// Each worker owns a deque per priority lane, pops its own jobs from the front
+// and steals from the back of the other workers when it runs dry
+// The workers are fixed when the pool is made (THREAD_POOL_WORKERS), submit() reads them
+// without a lock so they can't be resized while it's running
+class ThreadPool: public Global<ThreadPool> {
+    static constexpr int LANE_COUNT = 2;
+
+    struct Worker {
+        std::deque<std::function<void()>> lanes[LANE_COUNT];
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _pending{0};
+    std::atomic<size_t> _next_worker{0};
+    std::atomic<bool> _stop{false};
+    std::mutex _sleep_mutex;
+    std::condition_variable _sleep;
+    std::atomic<uint64_t> _executed{0};
+    std::atomic<uint64_t> _stolen{0};
+    mutable std::mutex _threads_mutex;
+
+    inline static thread_local int _worker_index = -1;
+
+    static size_t default_worker_count() {
+        if (THREAD_POOL_WORKERS > 0)
+            return THREAD_POOL_WORKERS;
+        // Leave a core for the main thread
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 1;
+    }
+
+    bool pop_local(Worker &worker, int lane, std::function<void()> &job) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.lanes[lane].empty())
+            return false;
+        job = std::move(worker.lanes[lane].front());
+        worker.lanes[lane].pop_front();
+        return true;
+    }
+
+    bool steal(size_t thief, int lane, std::function<void()> &job) {
+        size_t count = _workers.size();
+        for (size_t i = 1; i < count; i++) {
+            Worker &victim = *_workers[(thief + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.lanes[lane].empty())
+                continue;
+            job = std::move(victim.lanes[lane].back());
+            victim.lanes[lane].pop_back();
+            _stolen++;
+            return true;
+        }
+        return false;
+    }
+
+    bool next_job(size_t index, std::function<void()> &job) {
+        // High priority work anywhere in the pool beats normal work in our own deque
+        for (int lane = 0; lane < LANE_COUNT; lane++)
+            if (pop_local(*_workers[index], lane, job) || steal(index, lane, job)) {
+                _pending--;
+                return true;
+            }
+        return false;
+    }
+
+    void worker_loop(size_t index) {
+        _worker_index = static_cast<int>(index);
+        while (true) {
+            std::function<void()> job;
+            if (next_job(index, job)) {
+                job();
+                _executed++;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            // Use timeout to prevent indefinite blocking during shutdown
+            _sleep.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return _stop.load() || _pending.load() > 0;
+            });
+            if (_stop.load() && _pending.load() == 0)
+                return;
+        }
+    }
+
+    void start(size_t worker_count) {
+        for (size_t i = 0; i < worker_count; i++)
+            _workers.push_back(std::make_unique<Worker>());
+        _threads.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; i++)
+            _threads.emplace_back([this, i]() {
+                this->worker_loop(i);
+            });
+    }
+
+public:
+    ThreadPool() {
+        start(default_worker_count());
+    }
+
+    ~ThreadPool() {
+        stop();
+    }
+
+    // Once the pool is stopping nothing would pick the job up, so it runs on the caller instead
+    void submit(std::function<void()> job, JobPriority priority = JobPriority::Normal, bool front = false) {
+        int lane = static_cast<int>(priority);
+        // Jobs spawned by a worker stay local, everything else is spread round-robin
+        size_t index = _worker_index >= 0 && static_cast<size_t>(_worker_index) < _workers.size() ?
+                       static_cast<size_t>(_worker_index) :
+                       _next_worker++ % _workers.size();
+        {
+            // Take the sleep lock so a worker can't miss the wakeup between its check and wait,
+            // and so stop() can't let the workers exit between the check and the push
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            if (!_stop.load()) {
+                {
+                    Worker &worker = *_workers[index];
+                    std::lock_guard<std::mutex> guard(worker.mutex);
+                    if (front)
+                        worker.lanes[lane].push_front(std::move(job));
+                    else
+                        worker.lanes[lane].push_back(std::move(job));
+                }
+                _pending++;
+                lock.unlock();
+                _sleep.notify_one();
+                return;
+            }
+        }
+        job();
+        _executed++;
+    }
+
+    // Finishes all queued work, then joins the workers
+    void stop() {
+        std::lock_guard<std::mutex> guard(_threads_mutex);
+        {
+            std::lock_guard<std::mutex> lock(_sleep_mutex);
+            _stop.store(true);
+        }
+        _sleep.notify_all();
+        for (auto& thread : _threads)
+            if (thread.joinable())
+                thread.join();
+        _threads.clear();
+    }
+
+    static bool is_worker_thread() {
+        return _worker_index >= 0;
+    }
+
+    static int worker_index() {
+        return _worker_index;
+    }
+
+    size_t worker_count() const {
+        std::lock_guard<std::mutex> guard(_threads_mutex);
+        return _threads.size();
+    }
+
+    size_t pending_jobs() const {
+        return _pending.load();
+    }
+
+    uint64_t executed_jobs() const {
+        return _executed.load();
+    }
+
+    uint64_t stolen_jobs() const {
+        return _stolen.load();
+    }
+};
@@ -25,8 +25,15 @@ class VertexBatch {
     sg_bindings _bind = {SG_INVALID_ID};
     size_t _capacity;
     size_t _count = 0;
+    size_t _buffer_size = 0;
     std::unique_ptr<T[]> _vertices;
 
+    // Never created buffers are skipped without asking sokol, so batches can live outside a gfx context
+    bool has_buffer() const {
+        return _bind.vertex_buffers[0].id != SG_INVALID_ID &&
+               sg_query_buffer_state(_bind.vertex_buffers[0]) == SG_RESOURCESTATE_VALID;
+    }
+
     void resize(size_t new_capacity) {
         auto new_vertices = std::make_unique<T[]>(new_capacity);
         std::copy(_vertices.get(), _vertices.get() + _count, new_vertices.get());
@@ -47,32 +54,36 @@ public:
         : _bind(other._bind)
         , _capacity(other._capacity)
         , _count(other._count)
+        , _buffer_size(other._buffer_size)
         , _vertices(std::move(other._vertices))
     {
         other._bind = {};
         other._capacity = 0;
         other._count = 0;
+        other._buffer_size = 0;
     }
 
     VertexBatch& operator=(VertexBatch&& other) noexcept {
         if (this != &other) {
-            if (sg_query_buffer_state(_bind.vertex_buffers[0]) == SG_RESOURCESTATE_VALID)
+            if (has_buffer())
                 sg_destroy_buffer(_bind.vertex_buffers[0]);
 
             _bind = other._bind;
             _capacity = other._capacity;
             _count = other._count;
+            _buffer_size = other._buffer_size;
             _vertices = std::move(other._vertices);
 
             other._bind = {};
             other._capacity = 0;
             other._count = 0;
+            other._buffer_size = 0;
         }
         return *this;
     }
 
     ~VertexBatch() {
-        if (sg_query_buffer_state(_bind.vertex_buffers[0]) == SG_RESOURCESTATE_VALID)
+        if (has_buffer())
             sg_destroy_buffer(_bind.vertex_buffers[0]);
     }
 
@@ -81,6 +92,8 @@ public:
     }
 
     void add_vertices(const T* vertices, size_t count) {
+        if (!_vertices)
+            throw std::runtime_error("VertexBatch vertices have been discarded");
         if (_count + count > _capacity) {
             if (Dynamic)
                 while (_count + count > _capacity)
@@ -92,14 +105,34 @@ public:
         _count += count;
     }
 
+    // Take ownership of an exactly sized vertex array, replacing any existing data
+    void assign(std::unique_ptr<T[]> vertices, size_t count) {
+        _vertices = std::move(vertices);
+        _capacity = _count = count;
+    }
+
     void reserve(size_t new_capacity) {
         if (new_capacity > _capacity)
             resize(new_capacity);
     }
 
+    // Free the CPU copy once it's been uploaded, count() still reports what's in the buffer
+    void discard() {
+        _vertices.reset();
+        _capacity = 0;
+    }
+
+    // Destroy the GPU buffer, the batch has to be rebuilt before it can be drawn again
+    void release() {
+        if (has_buffer())
+            sg_destroy_buffer(_bind.vertex_buffers[0]);
+        _bind.vertex_buffers[0] = {SG_INVALID_ID};
+        _buffer_size = 0;
+    }
+
     void clear() {
         _count = 0;
-        if (Dynamic) {
+        if (Dynamic || !_vertices) {
             _capacity = InitialCapacity;
             _vertices = std::make_unique<T[]>(_capacity);
         } else
@@ -107,38 +140,53 @@ public:
     }
 
     bool is_ready() const {
-        return sg_query_buffer_state(_bind.vertex_buffers[0]) == SG_RESOURCESTATE_VALID;
+        return has_buffer();
     }
 
     bool build() {
+        if (!_vertices)
+            return is_ready();
         if (_count == 0)
             return false;
 
+        // Size the buffer to what's actually in the batch, not the capacity
         size_t required_size = sizeof(T) * _count;
-        size_t required_buffer_size = sizeof(T) * _capacity;
         
         // Always recreate the buffer to ensure it's the right size
         // This is safer and handles dynamic resizing properly
-        if (sg_query_buffer_state(_bind.vertex_buffers[0]) == SG_RESOURCESTATE_VALID)
+        if (has_buffer())
             sg_destroy_buffer(_bind.vertex_buffers[0]);
         
-        sg_buffer_desc desc = {
-            .usage.stream_update = true,
-            .size = required_buffer_size
-        };
-        _bind.vertex_buffers[0] = sg_make_buffer(&desc);
-        
         sg_range data = {
             .ptr = _vertices.get(),
             .size = required_size
         };
-        sg_update_buffer(_bind.vertex_buffers[0], &data);
+        if (Dynamic) {
+            sg_buffer_desc desc = {
+                .usage.stream_update = true,
+                .size = required_size
+            };
+            _bind.vertex_buffers[0] = sg_make_buffer(&desc);
+            sg_update_buffer(_bind.vertex_buffers[0], &data);
+        } else {
+            // Fixed batches never change after being built, so upload once as immutable
+            sg_buffer_desc desc = {
+                .data = data
+            };
+            _bind.vertex_buffers[0] = sg_make_buffer(&desc);
+        }
+        _buffer_size = required_size;
         if (_texture != nullptr)
             _texture->bind(_bind);
 
         return true;
     }
 
+    // Index buffer to draw with, it's shared between batches so it's never destroyed here
+    void set_index_buffer(sg_buffer buffer) {
+        _bind.index_buffer = buffer;
+    }
+
     void flush(bool empty_after=false) {
         if (!is_ready())
             throw std::runtime_error("VertexBatch is not built");
@@ -148,8 +196,18 @@ public:
             clear();
     }
     
+    // Draw the first elements of the index buffer set with set_index_buffer()
+    void flush_indexed(size_t elements) {
+        if (!is_ready())
+            throw std::runtime_error("VertexBatch is not built");
+        sg_apply_bindings(&_bind);
+        sg_draw(0, (int)elements, 1);
+    }
+
     size_t count() const { return _count; }
     size_t capacity() const { return _capacity; }
+    size_t cpu_bytes() const { return _vertices ? sizeof(T) * _capacity : 0; }
+    size_t gpu_bytes() const { return is_ready() ? _buffer_size : 0; }
     bool empty() const { return _count == 0; }
     bool full() const { return Dynamic ? false : _count >= _capacity; }
 };
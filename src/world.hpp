@@ -31,11 +31,15 @@
 
 class World {
     uuid::v4::UUID _id;
+    std::string _archive_path;
 
     Camera _camera;
     Texture *_tilemap;
     sg_shader _shader;
     sg_pipeline _pipeline;
+    sg_shader _chunk_shader;
+    sg_shader _tilemap_shader;
+    sg_pipeline _tilemap_pipeline;
     sg_pipeline _entity_pipeline;
 
     flecs::world *_world = nullptr;
@@ -50,117 +54,33 @@ class World {
         std::cerr.flush();
     }
 
-    std::string _get_world_directory() {
-        std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
-        std::filesystem::path world_dir = temp_dir / _id.String();
-        if (!std::filesystem::exists(world_dir))
-            std::filesystem::create_directories(world_dir);
-        return world_dir.string();
-    }
-
-    std::string _get_chunk_filepath(int x, int y) {
-        uint64_t chunk_index = index(x, y);
-        std::string filename = std::to_string(chunk_index) + ".nicechunk";
-        std::filesystem::path world_dir = _get_world_directory();
-        return (world_dir / filename).string();
-    }
-
+    // Chunks were appended to the archive as they were saved, all that's left is the
+    // last few the shutdown flushed and the session's region files
     void _export() {
         try {
-            std::string archive_name = _id.String() + ".niceworld";
-            std::cout << fmt::format("Creating world archive: {}\n", archive_name);
-            zip* archive = zip_open(archive_name.c_str(), "w");
-            if (!archive) {
-                std::cout << fmt::format("Failed to create archive: {}\n", archive_name);
-                return;
-            }
-            std::string world_dir = _get_world_directory();
-
-            // Iterate through all .nicechunk files in the world directory
-            for (const auto& entry : std::filesystem::directory_iterator(world_dir))
-                if (entry.is_regular_file() && entry.path().extension() == ".nicechunk") {
-                    std::string file_path = entry.path().string();
-                    std::string filename = entry.path().filename().string();
-                    FILE* file = fopen(file_path.c_str(), "rb");
-                    if (!file) {
-                        std::cout << fmt::format("Failed to open file for archiving: {}\n", file_path);
-                        continue;
-                    }
-                    bool success = zip_append_file_ex(archive, file_path.c_str(), filename.c_str(), file, 6); // compression level 6
-                    fclose(file);
-                    if (success)
-                        std::cout << fmt::format("Added {} to archive\n", filename);
-                    else
-                        std::cout << fmt::format("Failed to add {} to archive\n", filename);
-                }
-
-            zip_close(archive);
-            std::cout << fmt::format("World archive created successfully: {}\n", archive_name);
+            std::string world_dir = $Chunks.save_directory();
+            $Chunks.close_storage();
+            std::cout << fmt::format("World saved: {}\n", _archive_path);
 
-            // Clean up the temporary directory after successful archiving
             std::filesystem::remove_all(world_dir);
             std::cout << fmt::format("Cleaned up temporary directory: {}\n", world_dir);
         } catch (const std::exception& e) {
-            std::cout << fmt::format("Error creating world archive: {}\n", e.what());
+            std::cout << fmt::format("Error saving world archive: {}\n", e.what());
         }
     }
 
+    // Only the archive's directory is read here, chunks are decompressed as they're requested
     bool _import(const std::string& archive_path) {
-        try {
-            std::cout << fmt::format("Loading world from archive: {}\n", archive_path);
-            zip* archive = zip_open(archive_path.c_str(), "r");
-            if (!archive) {
-                std::cout << fmt::format("Failed to open archive: {}\n", archive_path);
-                return false;
-            }
-            std::string world_dir = _get_world_directory();
-            unsigned count = zip_count(archive);
-            std::cout << fmt::format("Archive contains {} files\n", count);
-
-            for (unsigned i = 0; i < count; i++) {
-                char* filename = zip_name(archive, i);
-                if (filename && strstr(filename, ".nicechunk")) {
-                    std::string output_path = (std::filesystem::path(world_dir) / filename).string();
-                    FILE* output_file = fopen(output_path.c_str(), "wb");
-                    if (!output_file) {
-                        std::cout << fmt::format("Failed to create output file: {}\n", output_path);
-                        continue;
-                    }
-                    bool success = zip_extract_file(archive, i, output_file);
-                    fclose(output_file);
-                    if (success)
-                        std::cout << fmt::format("Extracted {} from archive\n", filename);
-                    else
-                        std::cout << fmt::format("Failed to extract {} from archive\n", filename);
-                }
-            }
-
-            zip_close(archive);
-            std::cout << fmt::format("World loaded successfully from archive\n");
-        } catch (const std::exception& e) {
-            std::cout << fmt::format("Error loading world from archive: {}\n", e.what());
+        std::cout << fmt::format("Loading world from archive: {}\n", archive_path);
+        if (!$Chunks.attach_archive(archive_path)) {
+            std::cout << fmt::format("Failed to open archive: {}\n", archive_path);
             return false;
         }
+        std::cout << fmt::format("Archive contains {} chunks\n", $Chunks.archived_chunks());
 
         // Extract UUID from filename if possible
-        std::filesystem::path p;
         std::string filename = std::filesystem::path(archive_path).filename().string();
         _id = filename.substr(0, filename.find('.'));
-        // Loop through extracted chunk files and queue them
-        std::string world_dir = _get_world_directory();
-        for (const auto& entry : std::filesystem::directory_iterator(world_dir))
-            if (entry.is_regular_file() && entry.path().extension() == ".nicechunk") {
-                std::string file_path = entry.path().string();
-                std::string fname = entry.path().filename().string();
-                try {
-                    uint64_t chunk_index = std::stoull(fname.substr(0, fname.find('.')));
-                    auto [x, y] = unindex(chunk_index);
-                    $Chunks.ensure_chunk(x, y, false);
-                } catch (const std::exception& e) {
-                    std::cout << fmt::format("Failed to parse chunk filename {}: {}\n", fname, e.what());
-                    return false;
-                }
-            }
         return true;
     }
 
@@ -289,13 +209,14 @@ public:
     World(const char *path = nullptr): _id(uuid::v4::UUID::New()) {
         // Initialize graphics resources
         _shader = sg_make_shader(basic_shader_desc(sg_query_backend()));
+        _chunk_shader = sg_make_shader(chunk_shader_desc(sg_query_backend()));
         sg_pipeline_desc desc = {
-            .shader = _shader,
+            .shader = _chunk_shader,
             .layout = {
                 .buffers[0].stride = sizeof(ChunkVertex),
                 .attrs = {
-                    [ATTR_basic_position].format = SG_VERTEXFORMAT_FLOAT2,
-                    [ATTR_basic_texcoord].format = SG_VERTEXFORMAT_FLOAT2
+                    [ATTR_chunk_position].format = SG_VERTEXFORMAT_SHORT2,
+                    [ATTR_chunk_texcoord].format = SG_VERTEXFORMAT_USHORT2N
                 }
             },
             .depth = {
@@ -303,10 +224,25 @@ public:
                 .compare = SG_COMPAREFUNC_LESS_EQUAL,
                 .write_enabled = true
             },
+            .index_type = SG_INDEXTYPE_UINT32,
             .cull_mode = SG_CULLMODE_BACK,
             .colors[0].pixel_format = SG_PIXELFORMAT_RGBA8
         };
         _pipeline = sg_make_pipeline(&desc);
+        // Tile images draw a single quad from the vertex index, there's no vertex buffer to describe
+        _tilemap_shader = sg_make_shader(tilemap_shader_desc(sg_query_backend()));
+        sg_pipeline_desc tilemap_desc = desc;
+        tilemap_desc.shader = _tilemap_shader;
+        tilemap_desc.layout = {};
+        tilemap_desc.index_type = SG_INDEXTYPE_NONE;
+        _tilemap_pipeline = sg_make_pipeline(&tilemap_desc);
+        // Entities are still batched as float vertices without indices
+        desc.shader = _shader;
+        desc.layout = {};
+        desc.layout.buffers[0].stride = sizeof(BasicVertex);
+        desc.layout.attrs[ATTR_basic_position].format = SG_VERTEXFORMAT_FLOAT2;
+        desc.layout.attrs[ATTR_basic_texcoord].format = SG_VERTEXFORMAT_FLOAT2;
+        desc.index_type = SG_INDEXTYPE_NONE;
         desc.colors[0] = {
             .pixel_format = SG_PIXELFORMAT_RGBA8,
             .blend = {
@@ -322,13 +258,36 @@ public:
 
         // Initialize chunk manager
         $Chunks.initialize(&_camera, _tilemap, _id);
+        // Optional, without it every solid tile is drawn with the first tile in the atlas
+        GenericAsset *autotile_json = $Assets.get<>("autotile.json");
+        if (_tilemap && autotile_json && autotile_json->is_valid())
+            try {
+                $Chunks.set_autotile(AutotileTable::load(autotile_json->raw_data(), autotile_json->size(),
+                                                         _tilemap->width(), _tilemap->height()));
+            } catch (const std::exception& e) {
+                std::cout << fmt::format("Error loading autotile.json: {}\n", e.what());
+            }
 
         if (path != nullptr)
             if (!_import(path))
                 throw std::runtime_error("Failed to import world from archive");
+        // Kept in the archive so renaming or copying a save can't change the terrain around the
+        // chunks it has. Archives from before the manifest were generated from their name
+        uint64_t seed;
+        if (path == nullptr || !$Chunks.archived_seed(seed))
+            seed = Chunk::world_seed(_id.String());
+        $Chunks.set_seed(seed);
+        // Optional, runs on the workers in its own sandbox so it can't share anything with main.lua
+        GenericAsset *generate_lua = $Assets.get<>("generate.lua");
+        if (generate_lua && generate_lua->is_valid())
+            $Chunks.load_generation_script(std::string(reinterpret_cast<const char*>(generate_lua->raw_data()),
+                                                       generate_lua->size()), "generate.lua");
+        // Saves go back into the archive the world came from
+        _archive_path = path != nullptr ? path : _id.String() + ".niceworld";
+        $Chunks.save_to(_archive_path, seed);
 
         // Initialize world directory and print its location
-        std::string world_dir = _get_world_directory();
+        std::string world_dir = $Chunks.save_directory();
         std::cout << fmt::format("World initialized with UUID: {}\n", _id.String());
         std::cout << fmt::format("Chunk save directory: {}\n", world_dir);
 
@@ -1291,6 +1250,51 @@ public:
             return 0;
         });
 
+        lua_register(L, "set_tile", [](lua_State *L) -> int {
+            int tx = static_cast<int>(luaL_checkinteger(L, 1));
+            int ty = static_cast<int>(luaL_checkinteger(L, 2));
+            bool solid = lua_toboolean(L, 3);
+            lua_pushboolean(L, $Chunks.set_tile(tx, ty, solid));
+            return 1;
+        });
+
+        lua_register(L, "get_tile", [](lua_State *L) -> int {
+            int tx = static_cast<int>(luaL_checkinteger(L, 1));
+            int ty = static_cast<int>(luaL_checkinteger(L, 2));
+            auto tile = $Chunks.get_tile(tx, ty);
+            if (!tile.has_value()) {
+                lua_pushnil(L);
+                return 1;
+            }
+            lua_pushboolean(L, tile->solid != 0);
+            return 1;
+        });
+
+        lua_register(L, "save_world", [](lua_State *L) -> int {
+            lua_pushinteger(L, static_cast<lua_Integer>($Chunks.checkpoint()));
+            return 1;
+        });
+
+        lua_register(L, "spawn_points", [](lua_State *L) -> int {
+            int cx = static_cast<int>(luaL_checkinteger(L, 1));
+            int cy = static_cast<int>(luaL_checkinteger(L, 2));
+            auto points = $Chunks.spawn_points_in_chunk(cx, cy);
+            if (!points.has_value()) {
+                lua_pushnil(L);
+                return 1;
+            }
+            lua_createtable(L, static_cast<int>(points->size()), 0);
+            for (size_t i = 0; i < points->size(); i++) {
+                lua_createtable(L, 2, 0);
+                lua_pushinteger(L, (*points)[i].first);
+                lua_rawseti(L, -2, 1);
+                lua_pushinteger(L, (*points)[i].second);
+                lua_rawseti(L, -2, 2);
+                lua_rawseti(L, -2, i + 1);
+            }
+            return 1;
+        });
+
         lua_register(L, "random_empty_tile_in_chunk", [](lua_State *L) -> int {
             int cx = 0;
             int cy = 0;
@@ -1362,6 +1366,12 @@ public:
             sg_destroy_pipeline(_pipeline);
         if (sg_query_pipeline_state(_entity_pipeline) == SG_RESOURCESTATE_VALID)
             sg_destroy_pipeline(_entity_pipeline);
+        if (sg_query_pipeline_state(_tilemap_pipeline) == SG_RESOURCESTATE_VALID)
+            sg_destroy_pipeline(_tilemap_pipeline);
+        if (sg_query_shader_state(_tilemap_shader) == SG_RESOURCESTATE_VALID)
+            sg_destroy_shader(_tilemap_shader);
+        if (sg_query_shader_state(_chunk_shader) == SG_RESOURCESTATE_VALID)
+            sg_destroy_shader(_chunk_shader);
         _export();
     }
 
@@ -1375,10 +1385,11 @@ public:
         auto events_to_queue = $Chunks.release_chunks();
         $Chunks.queue_events(std::move(events_to_queue));
         $Chunks.fire_chunk_events();
+        $Chunks.upload_chunks();
 
         _chunk_entities.finalize(&_texture_registry, &_camera);
         _screen_entities.finalize(&_texture_registry);
-        $Chunks.draw_chunks(_pipeline, _camera.is_dirty());
+        $Chunks.draw_chunks(_pipeline, _tilemap_pipeline, _camera.is_dirty());
         sg_apply_pipeline(_entity_pipeline);
         _chunk_entities.flush(&_camera);
         _screen_entities.flush();
@@ -0,0 +1,237 @@
+//
+//  world_archive.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "just_zip.h"
+#include "json.hpp"
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+
+// The parts of a zip end record the archive code needs, just_zip keeps its own to itself
+struct ZipEndRecord {
+    static constexpr size_t size = 22;
+    static constexpr uint32_t signature = 0x06054B50;
+
+    uint16_t entries = 0;
+    uint32_t directory_size = 0;
+    uint32_t directory_offset = 0;
+
+    // The record at data, position bytes into the file. Only valid if its directory ends right
+    // where it starts, archives are written without a comment so nothing follows it either
+    static bool parse(const unsigned char *data, uint64_t position, ZipEndRecord &record) {
+        uint32_t magic;
+        uint16_t disk, directory_disk, disk_entries, comment;
+        std::memcpy(&magic, data, 4);
+        std::memcpy(&disk, data + 4, 2);
+        std::memcpy(&directory_disk, data + 6, 2);
+        std::memcpy(&disk_entries, data + 8, 2);
+        std::memcpy(&record.entries, data + 10, 2);
+        std::memcpy(&record.directory_size, data + 12, 4);
+        std::memcpy(&record.directory_offset, data + 16, 4);
+        std::memcpy(&comment, data + 20, 2);
+        return magic == signature && !disk && !directory_disk && disk_entries == record.entries && !comment &&
+               static_cast<uint64_t>(record.directory_offset) + record.directory_size == position;
+    }
+
+    void write(std::string &out) const {
+        uint16_t zero = 0;
+        auto put = [&](const void *value, size_t bytes) {
+            out.append(static_cast<const char*>(value), bytes);
+        };
+        put(&signature, 4);
+        put(&zero, 2);
+        put(&zero, 2);
+        put(&entries, 2);
+        put(&entries, 2);
+        put(&directory_size, 4);
+        put(&directory_offset, 4);
+        put(&zero, 2);
+    }
+};
+
+// Read side of a .niceworld archive, one "<index>.nicechunk" entry per chunk and a world.json
+// manifest with the world's seed, see WorldSaver
+// Opening only reads the zip's central directory, chunks are decompressed into
+// memory one at a time when they're first needed. The archive stays open until
+// close() so nothing is extracted to disk up front.
+class WorldArchive {
+    zip *_zip = nullptr;
+    std::string _path;
+    std::unordered_map<uint64_t, unsigned> _entries; // Chunk index -> zip entry, later entries win
+    size_t _entry_count = 0; // Every chunk entry, superseded ones included
+    bool _has_seed = false;
+    uint64_t _seed = 0;
+    mutable std::mutex _mutex;
+
+public:
+    WorldArchive() = default;
+
+    WorldArchive(const WorldArchive&) = delete;
+    WorldArchive& operator=(const WorldArchive&) = delete;
+
+    ~WorldArchive() {
+        close();
+    }
+
+    static std::string entry_name(uint64_t idx) {
+        return std::to_string(idx) + ".nicechunk";
+    }
+
+    static constexpr const char *manifest_name = "world.json";
+
+    static std::string manifest(uint64_t seed) {
+        return nlohmann::json{{"seed", seed}}.dump();
+    }
+
+    // Cut an append that never finished off the end of the archive. Appends only ever add to the
+    // end (see WorldSaver), so the last complete end record still describes a whole archive.
+    // Returns false if the file can't be read or has no end record to go back to
+    static bool repair(const std::string &path) {
+        std::error_code error;
+        uintmax_t length = std::filesystem::file_size(path, error);
+        if (error || length < ZipEndRecord::size)
+            return false;
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        unsigned char tail[ZipEndRecord::size];
+        ZipEndRecord record;
+        bool whole = fseek(file, static_cast<long>(length - ZipEndRecord::size), SEEK_SET) == 0 &&
+                     fread(tail, 1, sizeof(tail), file) == sizeof(tail) &&
+                     ZipEndRecord::parse(tail, length - ZipEndRecord::size, record);
+        if (whole) {
+            fclose(file);
+            return true;
+        }
+        // Only after a crash, so the whole file is read to find the record
+        std::vector<unsigned char> data(length);
+        bool read = fseek(file, 0, SEEK_SET) == 0 && fread(data.data(), 1, data.size(), file) == data.size();
+        fclose(file);
+        if (!read)
+            return false;
+        for (size_t at = length - ZipEndRecord::size + 1; at-- > 0;)
+            if (ZipEndRecord::parse(data.data() + at, at, record)) {
+                std::filesystem::resize_file(path, at + ZipEndRecord::size, error);
+                return !error;
+            }
+        return false;
+    }
+
+    bool open(const std::string &path) {
+        repair(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_zip)
+            zip_close(_zip);
+        _entries.clear();
+        _entry_count = 0;
+        _has_seed = false;
+        if (!(_zip = zip_open(path.c_str(), "r")))
+            return false;
+        _path = path;
+        unsigned count = zip_count(_zip);
+        for (unsigned i = 0; i < count; i++) {
+            const char *name = zip_name(_zip, i);
+            if (!name || !zip_file(_zip, i))
+                continue;
+            std::string filename = name;
+            // Written once when the archive's created, compaction carries it over
+            if (filename == manifest_name) {
+                std::string data(zip_size(_zip, i), '\0');
+                if (zip_extract_data(_zip, i, data.data(), static_cast<unsigned>(data.size())) == data.size()) {
+                    nlohmann::json json = nlohmann::json::parse(data, nullptr, false);
+                    if (json.is_object() && json.contains("seed") && json["seed"].is_number_unsigned()) {
+                        _seed = json["seed"].get<uint64_t>();
+                        _has_seed = true;
+                    }
+                }
+                continue;
+            }
+            size_t dot = filename.find(".nicechunk");
+            if (dot == std::string::npos || dot == 0)
+                continue;
+            try {
+                _entries[std::stoull(filename.substr(0, dot))] = i;
+                _entry_count++;
+            } catch (const std::exception&) {
+                continue;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_zip)
+            zip_close(_zip);
+        _zip = nullptr;
+        _entries.clear();
+        _entry_count = 0;
+        _has_seed = false;
+        _path.clear();
+    }
+
+    bool is_open() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _zip != nullptr;
+    }
+
+    const std::string& path() const {
+        return _path;
+    }
+
+    bool contains(uint64_t idx) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.find(idx) != _entries.end();
+    }
+
+    // Decompress a single chunk entry into memory
+    bool read(uint64_t idx, std::string &out) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(idx);
+        if (!_zip || it == _entries.end())
+            return false;
+        unsigned size = zip_size(_zip, it->second);
+        out.resize(size);
+        if (size == 0)
+            return true;
+        return zip_extract_data(_zip, it->second, out.data(), size) == size;
+    }
+
+    std::vector<uint64_t> chunks() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<uint64_t> result;
+        result.reserve(_entries.size());
+        for (const auto& [idx, entry] : _entries)
+            result.push_back(idx);
+        return result;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    // The seed the world was created with, false for archives from before the manifest
+    bool seed(uint64_t &seed) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        seed = _seed;
+        return _has_seed;
+    }
+
+    size_t entry_count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entry_count;
+    }
+};
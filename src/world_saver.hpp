@@ -0,0 +1,395 @@
+//
+//  world_saver.hpp
+//  nice
+//
+//  Created by George Watson on 16/10/2026.
+//
+
+#pragma once
+
+#include "nice_config.h"
+#include "thread_pool.hpp"
+#include "world_archive.hpp"
+#include "just_zip.h"
+#include "fmt/format.h"
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+struct WorldSaverStats {
+    size_t pending = 0;       // Chunks being compressed or waiting to be appended
+    uint64_t appended = 0;    // Chunk entries appended to the archive
+    uint64_t flushes = 0;     // Times the archive was opened to append a batch
+    uint64_t bytes = 0;       // Compressed bytes appended
+    size_t entries = 0;       // Chunk entries in the archive, superseded ones included
+    size_t chunks = 0;        // Distinct chunks in the archive
+    uint64_t compactions = 0; // Times the archive was rewritten without superseded entries
+};
+
+// Keeps a .niceworld archive up to date while the game is running
+// Saved chunks are deflated on the thread pool and appended to the archive in batches,
+// a later entry for a chunk supersedes the earlier ones (see WorldArchive). Once superseded
+// entries outnumber live ones the archive is rewritten in the background. The world's seed
+// goes in a manifest entry as soon as the archive is created, so it doesn't depend on the file name.
+class WorldSaver {
+    struct Compressed {
+        std::string data;
+        unsigned size;     // Uncompressed size
+        unsigned crc;
+        unsigned codec;    // 0 = stored, 8 = deflated
+        uint64_t sequence; // Order save() was called in, an older copy never replaces a newer one
+    };
+
+    std::string _path;
+    uint64_t _seed;
+    std::unordered_map<uint64_t, Compressed> _ready;
+    std::mutex _ready_lock;
+    std::atomic<uint64_t> _sequence{0};
+    std::atomic<size_t> _compressing{0}; // Jobs in flight
+    std::atomic<size_t> _queued{0};      // Jobs that haven't compressed their chunk yet
+    std::atomic<bool> _compacting{false};
+    std::mutex _idle_lock;
+    std::condition_variable _idle;
+
+    std::mutex _archive_lock; // Held while appending to or rewriting the archive
+    std::unordered_map<uint64_t, uint64_t> _chunks; // Chunk index -> sequence of its newest entry
+    std::atomic<size_t> _entries{0};
+    std::atomic<size_t> _chunk_count{0};
+
+    std::atomic<uint64_t> _appended{0};
+    std::atomic<uint64_t> _flushes{0};
+    std::atomic<uint64_t> _bytes{0};
+    std::atomic<uint64_t> _compactions{0};
+
+    void compress(uint64_t idx, std::string data, uint64_t sequence) {
+        Compressed entry = {
+            .size = static_cast<unsigned>(data.size()),
+            .crc = zip_crc32(0, data.data(), static_cast<unsigned>(data.size())),
+            .codec = 0,
+            .sequence = sequence
+        };
+        std::string deflated(zip_deflate_bounds(entry.size, WORLD_ARCHIVE_LEVEL), '\0');
+        unsigned length = zip_deflate(data.data(), entry.size, deflated.data(), static_cast<unsigned>(deflated.size()), WORLD_ARCHIVE_LEVEL);
+        if (length > 0) {
+            deflated.resize(length);
+            entry.data = std::move(deflated);
+            entry.codec = 8;
+        } else
+            entry.data = std::move(data);
+
+        std::lock_guard<std::mutex> lock(_ready_lock);
+        auto it = _ready.find(idx);
+        if (it == _ready.end() || it->second.sequence < sequence)
+            _ready[idx] = std::move(entry);
+    }
+
+    // Put entries that didn't make it into the archive back for the next flush, unless something
+    // newer came in since
+    void requeue(std::unordered_map<uint64_t, Compressed> &entries) {
+        std::lock_guard<std::mutex> ready(_ready_lock);
+        for (auto& [idx, entry] : entries) {
+            auto it = _ready.find(idx);
+            if (it == _ready.end() || it->second.sequence < entry.sequence)
+                _ready[idx] = std::move(entry);
+        }
+    }
+
+    // Writes the batch after the archive's end record, then a directory of the old entries and the
+    // new ones, then a new end record. Nothing already in the file is touched and the end record
+    // only goes down once everything before it is on disk, so a crash at any point leaves the old
+    // archive for WorldArchive::repair() to go back to. _archive_lock must be held
+    bool append(const std::vector<std::pair<std::string, const Compressed*>> &batch) {
+        WorldArchive::repair(_path);
+        bool exists = std::filesystem::exists(_path);
+        FILE *file = fopen(_path.c_str(), exists ? "r+b" : "w+b");
+        if (!file)
+            return false;
+        ZipEndRecord end;
+        std::string directory;
+        if (exists) {
+            unsigned char tail[ZipEndRecord::size];
+            long length = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+            if (length < static_cast<long>(ZipEndRecord::size) ||
+                fseek(file, length - static_cast<long>(ZipEndRecord::size), SEEK_SET) != 0 ||
+                fread(tail, 1, sizeof(tail), file) != sizeof(tail) ||
+                !ZipEndRecord::parse(tail, length - ZipEndRecord::size, end)) {
+                fclose(file);
+                return false;
+            }
+            directory.resize(end.directory_size);
+            if (fseek(file, end.directory_offset, SEEK_SET) != 0 ||
+                fread(directory.data(), 1, directory.size(), file) != directory.size()) {
+                fclose(file);
+                return false;
+            }
+        }
+        if (end.entries + batch.size() > 0xFFFF) {
+            fclose(file);
+            return false;
+        }
+
+        std::time_t now = std::time(nullptr);
+        std::tm *local = std::localtime(&now);
+        uint16_t time = static_cast<uint16_t>(local->tm_hour << 11 | local->tm_min << 5 | local->tm_sec / 2);
+        uint16_t date = static_cast<uint16_t>((local->tm_year - 80) << 9 | (local->tm_mon + 1) << 5 | local->tm_mday);
+        // Same fields just_zip writes, see zip_append_raw()
+        auto put = [](std::string &out, uint64_t value, size_t bytes) {
+            out.append(reinterpret_cast<const char*>(&value), bytes);
+        };
+        bool ok = fseek(file, 0, SEEK_END) == 0;
+        for (const auto& [name, compressed] : batch) {
+            if (!ok)
+                break;
+            const Compressed &entry = *compressed;
+            long offset = ftell(file);
+            std::string header;
+            put(header, 0x04034B50, 4);
+            put(header, 10, 2);
+            put(header, 0, 2);
+            put(header, entry.codec, 2);
+            put(header, time, 2);
+            put(header, date, 2);
+            put(header, entry.crc, 4);
+            put(header, entry.data.size(), 4);
+            put(header, entry.size, 4);
+            put(header, name.size(), 2);
+            put(header, 0, 2);
+            header += name;
+            ok = offset >= 0 && fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                 fwrite(entry.data.data(), 1, entry.data.size(), file) == entry.data.size();
+
+            put(directory, 0x02014B50, 4);
+            put(directory, 10, 2);
+            put(directory, 10, 2);
+            put(directory, 0, 2);
+            put(directory, entry.codec, 2);
+            put(directory, time, 2);
+            put(directory, date, 2);
+            put(directory, entry.crc, 4);
+            put(directory, entry.data.size(), 4);
+            put(directory, entry.size, 4);
+            put(directory, name.size(), 2);
+            put(directory, 0, 2);  // Extra field
+            put(directory, 0, 2);  // Comment
+            put(directory, 0, 2);  // Disk
+            put(directory, 0, 2);  // Internal attributes
+            put(directory, 0x20, 4);
+            put(directory, offset, 4);
+            directory += name;
+        }
+        long offset = ok ? ftell(file) : -1;
+        ok = offset >= 0 &&
+             fwrite(directory.data(), 1, directory.size(), file) == directory.size() &&
+             fflush(file) == 0 && fsync(fileno(file)) == 0;
+        if (ok) {
+            end.entries = static_cast<uint16_t>(end.entries + batch.size());
+            end.directory_size = static_cast<uint32_t>(directory.size());
+            end.directory_offset = static_cast<uint32_t>(offset);
+            std::string record;
+            end.write(record);
+            ok = fwrite(record.data(), 1, record.size(), file) == record.size() &&
+                 fflush(file) == 0 && fsync(fileno(file)) == 0;
+        }
+        fclose(file);
+        // Whatever did get written goes, the archive is back to how it was
+        if (!ok && exists)
+            WorldArchive::repair(_path);
+        else if (!ok)
+            std::filesystem::remove(_path);
+        return ok;
+    }
+
+    // Rewrites the archive with only the newest entry of each chunk, _archive_lock must be held
+    void compact() {
+        std::string temp = _path + ".tmp";
+        WorldArchive source;
+        if (!source.open(_path))
+            return;
+        zip *archive = zip_open(temp.c_str(), "w");
+        if (!archive) {
+            std::cout << fmt::format("Failed to create archive: {}\n", temp);
+            return;
+        }
+        std::string data;
+        size_t count = 0;
+        bool ok = true;
+        for (uint64_t idx : source.chunks()) {
+            std::string name = WorldArchive::entry_name(idx);
+            if (!source.read(idx, data) ||
+                !zip_append_mem(archive, name.c_str(), data.data(), static_cast<unsigned>(data.size()), WORLD_ARCHIVE_LEVEL)) {
+                ok = false;
+                break;
+            }
+            count++;
+        }
+        std::string manifest = WorldArchive::manifest(_seed);
+        unsigned length = static_cast<unsigned>(manifest.size());
+        ok = ok && zip_append_raw(archive, WorldArchive::manifest_name, manifest.data(), length, length,
+                                  zip_crc32(0, manifest.data(), length), 0);
+        zip_close(archive);
+        source.close();
+        if (!ok) {
+            std::cout << fmt::format("Failed to compact world archive: {}\n", _path);
+            std::filesystem::remove(temp);
+            return;
+        }
+        std::filesystem::rename(temp, _path);
+        std::cout << fmt::format("Compacted world archive {} from {} to {} entries\n", _path, _entries.load(), count);
+        _entries = count;
+        _compactions++;
+    }
+
+public:
+    // The seed is only written if the archive doesn't have a manifest yet, i.e. it's new
+    WorldSaver(const std::string &path, uint64_t seed): _path(path), _seed(seed) {
+        // zip's crc table is filled on first use, do that here before any worker can race for it
+        zip_crc32(0, nullptr, 0);
+        WorldArchive existing;
+        uint64_t existing_seed;
+        if (std::filesystem::exists(_path) && existing.open(_path)) {
+            for (uint64_t idx : existing.chunks())
+                _chunks[idx] = 0;
+            _entries = existing.entry_count();
+            _chunk_count = _chunks.size();
+            if (existing.seed(existing_seed))
+                return;
+        }
+        existing.close();
+        std::string manifest = WorldArchive::manifest(seed);
+        Compressed entry = {
+            .size = static_cast<unsigned>(manifest.size()),
+            .crc = zip_crc32(0, manifest.data(), static_cast<unsigned>(manifest.size())),
+            .codec = 0,
+            .sequence = 0
+        };
+        entry.data = std::move(manifest);
+        if (!append({{WorldArchive::manifest_name, &entry}}))
+            std::cout << fmt::format("Failed to write the manifest to archive: {}\n", _path);
+    }
+
+    WorldSaver(const WorldSaver&) = delete;
+    WorldSaver& operator=(const WorldSaver&) = delete;
+
+    ~WorldSaver() {
+        finish();
+    }
+
+    const std::string& path() const {
+        return _path;
+    }
+
+    // Queue a serialized chunk, it's compressed on the pool and appended with the next batch
+    void save(uint64_t idx, std::string data) {
+        uint64_t sequence = ++_sequence;
+        _compressing++;
+        _queued++;
+        $Pool.submit([this, idx, data = std::move(data), sequence]() mutable {
+            compress(idx, std::move(data), sequence);
+            // The job that compresses the last queued chunk appends the batch, skipped if the archive is busy
+            if (_queued.fetch_sub(1) == 1)
+                flush(false);
+            {
+                std::lock_guard<std::mutex> lock(_idle_lock);
+                _compressing--;
+                _idle.notify_all();
+            }
+        });
+    }
+
+    // Append every compressed chunk to the archive
+    // Returns false without appending if the archive is busy and wait is false
+    bool flush(bool wait = true) {
+        std::unique_lock<std::mutex> lock(_archive_lock, std::defer_lock);
+        if (wait)
+            lock.lock();
+        else if (!lock.try_lock())
+            return false;
+
+        std::unordered_map<uint64_t, Compressed> batch;
+        {
+            std::lock_guard<std::mutex> ready(_ready_lock);
+            batch.swap(_ready);
+        }
+        // Anything older than what's already in the archive finished compressing late, drop it
+        for (auto it = batch.begin(); it != batch.end();) {
+            auto chunk = _chunks.find(it->first);
+            if (chunk != _chunks.end() && chunk->second >= it->second.sequence)
+                it = batch.erase(it);
+            else
+                ++it;
+        }
+        if (batch.empty())
+            return true;
+
+        std::vector<std::pair<std::string, const Compressed*>> named;
+        for (const auto& [idx, entry] : batch)
+            named.emplace_back(WorldArchive::entry_name(idx), &entry);
+        if (!append(named)) {
+            std::cout << fmt::format("Failed to append {} chunks to archive: {}\n", batch.size(), _path);
+            requeue(batch);
+            return false;
+        }
+        for (auto& [idx, entry] : batch) {
+            _chunks[idx] = entry.sequence;
+            _entries++;
+            _bytes += entry.data.size();
+        }
+        _chunk_count = _chunks.size();
+        _appended += batch.size();
+        _flushes++;
+        std::cout << fmt::format("Appended {} chunks to world archive {}\n", batch.size(), _path);
+
+        size_t entries = _entries.load();
+        if (entries >= WORLD_ARCHIVE_COMPACT_MIN && entries - _chunks.size() > _chunks.size() && !_compacting.exchange(true))
+            $Pool.submit([this]() {
+                {
+                    std::lock_guard<std::mutex> lock(_archive_lock);
+                    compact();
+                }
+                // Appends that were skipped while the archive was being rewritten
+                flush(false);
+                std::lock_guard<std::mutex> lock(_idle_lock);
+                _compacting.store(false);
+                _idle.notify_all();
+            });
+        return true;
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(_idle_lock);
+        _idle.wait(lock, [this] {
+            return _compressing.load() == 0 && !_compacting.load();
+        });
+    }
+
+    // Wait for everything saved so far to be compressed and appended
+    void finish() {
+        wait_idle();
+        flush();
+        // The last flush may have started a compaction
+        wait_idle();
+    }
+
+    WorldSaverStats stats() {
+        WorldSaverStats stats;
+        {
+            std::lock_guard<std::mutex> lock(_ready_lock);
+            stats.pending = _ready.size();
+        }
+        stats.pending += _compressing.load();
+        stats.entries = _entries.load();
+        stats.chunks = _chunk_count.load();
+        stats.appended = _appended.load();
+        stats.flushes = _flushes.load();
+        stats.bytes = _bytes.load();
+        stats.compactions = _compactions.load();
+        return stats;
+    }
+};